@@ -0,0 +1,79 @@
+/*
+ * @file convbench.c
+ * @brief Microbenchmark: guitol/guintol against glibc strtol.
+ *
+ * Parses a block of newline-separated decimal numbers of 1 to 18 digits,
+ * the way `head -n`, `seq` or `sort -n` see them, with strtol, with guitol
+ * and with guintol on the same bytes as (pointer, length) slices, and
+ * prints ns per number. Unlike the tools, this program links libc on
+ * purpose, for the reference implementation and the clock.
+ *
+ * Build and run with: make bench
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lib.h"
+
+#define VALUE_COUNT 4096
+#define ITERS 500
+
+static volatile long sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define BENCH(name, expr)                                                      \
+  do {                                                                         \
+    long acc = 0;                                                              \
+    double t0 = now_ns();                                                      \
+    for (int it = 0; it < ITERS; ++it) {                                       \
+      for (int i = 0; i < VALUE_COUNT; ++i) {                                  \
+        const char *S = text + starts[i];                                      \
+        size_t L = lens[i];                                                    \
+        (void)L;                                                               \
+        acc += (expr);                                                         \
+      }                                                                        \
+    }                                                                          \
+    sink = acc;                                                                \
+    printf("  %-10s %7.2f ns\n", name,                                         \
+           (now_ns() - t0) / ((double)ITERS * VALUE_COUNT));                   \
+  } while (0)
+
+static void run(const char *label, int min_digits, int max_digits) {
+  static char text[VALUE_COUNT * 21];
+  static size_t starts[VALUE_COUNT], lens[VALUE_COUNT];
+  size_t pos = 0;
+
+  for (int i = 0; i < VALUE_COUNT; ++i) {
+    int digits = min_digits + rand() % (max_digits - min_digits + 1);
+    starts[i] = pos;
+    text[pos++] = (char)('1' + rand() % 9);
+    for (int d = 1; d < digits; ++d) {
+      text[pos++] = (char)('0' + rand() % 10);
+    }
+    lens[i] = pos - starts[i];
+    text[pos++] = '\n';
+  }
+  text[pos] = '\0';
+
+  printf("%s:\n", label);
+  BENCH("strtol", strtol(S, NULL, 10));
+  BENCH("guitol", guitol(S, NULL, 10));
+  BENCH("guintol", guintol(S, L, NULL, 10));
+}
+
+int main(void) {
+  srand(1);
+  run("1-4 digits", 1, 4);
+  run("5-12 digits", 5, 12);
+  run("13-18 digits", 13, 18);
+  return 0;
+}
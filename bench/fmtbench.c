@@ -0,0 +1,71 @@
+/*
+ * @file fmtbench.c
+ * @brief Microbenchmark: lib number formatting against snprintf.
+ *
+ * Formats the kind of values `ls -l` prints (link counts, ids, sizes from
+ * a few bytes to terabytes) with gui_fmt_u64 and gui_fmt_human and with
+ * the closest snprintf call, and prints ns per number. Unlike the tools,
+ * this program links libc on purpose, for the reference implementation
+ * and the clock.
+ *
+ * Build and run with: make bench
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fmt.h"
+
+#define VALUE_COUNT 4096
+#define ITERS 500
+
+static volatile size_t sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define BENCH(name, expr)                                                      \
+  do {                                                                         \
+    size_t acc = 0;                                                            \
+    double t0 = now_ns();                                                      \
+    for (int it = 0; it < ITERS; ++it) {                                       \
+      for (int i = 0; i < VALUE_COUNT; ++i) {                                  \
+        uint64_t V = values[i];                                                \
+        acc += (size_t)(expr);                                                 \
+      }                                                                        \
+    }                                                                          \
+    sink = acc;                                                                \
+    printf("  %-14s %7.2f ns\n", name,                                         \
+           (now_ns() - t0) / ((double)ITERS * VALUE_COUNT));                   \
+  } while (0)
+
+int main(void) {
+  static uint64_t values[VALUE_COUNT];
+  char buf[GUI_FMT_MAX];
+
+  srand(1);
+  for (int i = 0; i < VALUE_COUNT; ++i) {
+    // Uniform in the number of digits, like a directory of mixed files.
+    int digits = 1 + rand() % 13;
+    uint64_t v = 1;
+    for (int d = 1; d < digits; ++d) {
+      v = v * 10 + (uint64_t)(rand() % 10);
+    }
+    values[i] = v;
+  }
+
+  printf("format %d values x %d:\n", VALUE_COUNT, ITERS);
+  BENCH("gui_fmt_u64", gui_fmt_u64(buf, V));
+  BENCH("snprintf %llu",
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)V));
+  BENCH("gui_fmt_human", gui_fmt_human(buf, V));
+  BENCH("gui_fmt_hex", gui_fmt_hex(buf, V));
+  BENCH("snprintf %llx",
+        snprintf(buf, sizeof(buf), "%llx", (unsigned long long)V));
+  return 0;
+}
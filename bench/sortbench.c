@@ -0,0 +1,152 @@
+/*
+ * @file sortbench.c
+ * @brief Microbenchmark: gui_sort on directory-entry names against qsort.
+ *
+ * Sorts 1M random d_name-like strings (with long shared prefixes, as in
+ * real directories) by name, once through (prefix key, pointer) pairs with
+ * gui_sort and once through glibc qsort over plain string pointers, and
+ * prints the time of each. Unlike the tools, this program links libc on
+ * purpose, for the reference implementation and the clock.
+ *
+ * It first checks names that share prefixes hundreds of bytes long
+ * ("ab", "aab", ... and a group under "a" * 250), sorted on a thread with
+ * a 64 KiB stack: the radix sort must not recurse once per shared byte.
+ *
+ * Build and run with: make bench
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lib.h"
+#include "sort.h"
+
+#define NAME_COUNT (1024 * 1024)
+#define ROUNDS 5
+#define PREFIX_RUNS 250
+#define PREFIX_GROUP 40
+#define PREFIX_COUNT (PREFIX_RUNS + PREFIX_GROUP)
+
+static const char *prefixes[] = {"", "lib", "libgui-", "file_", "IMG_2024",
+                                 "x"};
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_ptr(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static char prefix_names[PREFIX_COUNT][PREFIX_RUNS + 8];
+static gui_sort_item prefix_items[PREFIX_COUNT];
+
+static void *sort_prefix_items(void *arg) {
+  (void)arg;
+  gui_sort_strings(prefix_items, PREFIX_COUNT);
+  return NULL;
+}
+
+/**
+ * @brief Sorts the long-shared-prefix names on a small stack and compares
+ * the result with qsort. Returns 0 when they agree.
+ */
+
+static int check_long_prefixes(void) {
+  char *expect[PREFIX_COUNT];
+  for (int k = 0; k < PREFIX_RUNS; ++k) {
+    memset(prefix_names[k], 'a', k);
+    prefix_names[k][k] = 'b';
+  }
+  for (int i = 0; i < PREFIX_GROUP; ++i) {
+    char *name = prefix_names[PREFIX_RUNS + i];
+    memset(name, 'a', PREFIX_RUNS);
+    // Reverse order, so the group actually needs sorting.
+    sprintf(name + PREFIX_RUNS, "c%02d", PREFIX_GROUP - 1 - i);
+  }
+  for (int i = 0; i < PREFIX_COUNT; ++i) {
+    prefix_items[i].ptr = prefix_names[i];
+    expect[i] = prefix_names[i];
+  }
+  qsort(expect, PREFIX_COUNT, sizeof(char *), cmp_ptr);
+
+  pthread_attr_t attr;
+  pthread_t thread;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 64 * 1024);
+  if (pthread_create(&thread, &attr, sort_prefix_items, NULL) != 0) {
+    printf("long prefixes: cannot start thread\n");
+    return 1;
+  }
+  pthread_join(thread, NULL);
+  for (int i = 0; i < PREFIX_COUNT; ++i) {
+    if (strcmp(prefix_items[i].ptr, expect[i]) != 0) {
+      printf("long prefixes: mismatch at %d\n", i);
+      return 1;
+    }
+  }
+  printf("long prefixes: %d names sorted on a 64 KiB stack\n", PREFIX_COUNT);
+  return 0;
+}
+
+int main(void) {
+  if (check_long_prefixes() != 0) {
+    return 1;
+  }
+
+  char **names = malloc(NAME_COUNT * sizeof(char *));
+  char **work = malloc(NAME_COUNT * sizeof(char *));
+  gui_sort_item *items = malloc(NAME_COUNT * sizeof(gui_sort_item));
+
+  // One contiguous pool, like the entry records mini-ls sorts.
+  char *pool = malloc(NAME_COUNT * 32);
+  char *next = pool;
+  srand(1);
+  for (size_t i = 0; i < NAME_COUNT; ++i) {
+    const char *prefix = prefixes[rand() % 6];
+    size_t plen = strlen(prefix);
+    size_t len = plen + 4 + (size_t)rand() % 16;
+    names[i] = next;
+    next += len + 1;
+    memcpy(names[i], prefix, plen);
+    for (size_t j = plen; j < len; ++j) {
+      names[i][j] = "abcdefghijklmnopqrstuvwxyz0123456789._-"[rand() % 39];
+    }
+    names[i][len] = '\0';
+  }
+
+  double best_gui = 1e30, best_libc = 1e30;
+  for (int round = 0; round < ROUNDS; ++round) {
+    double t0 = now_ns();
+    for (size_t i = 0; i < NAME_COUNT; ++i) {
+      items[i].ptr = names[i];
+    }
+    gui_sort_strings(items, NAME_COUNT);
+    double t = now_ns() - t0;
+    best_gui = t < best_gui ? t : best_gui;
+
+    memcpy(work, names, NAME_COUNT * sizeof(char *));
+    t0 = now_ns();
+    qsort(work, NAME_COUNT, sizeof(char *), cmp_ptr);
+    t = now_ns() - t0;
+    best_libc = t < best_libc ? t : best_libc;
+
+    for (size_t i = 0; i < NAME_COUNT; ++i) {
+      if (items[i].ptr != work[i] && strcmp(items[i].ptr, work[i]) != 0) {
+        printf("mismatch at %zu\n", i);
+        return 1;
+      }
+    }
+  }
+
+  printf("sort %d names (best of %d):\n", NAME_COUNT, ROUNDS);
+  printf("  gui_sort_strings %9.2f ms\n", best_gui / 1e6);
+  printf("  qsort            %9.2f ms\n", best_libc / 1e6);
+  return 0;
+}
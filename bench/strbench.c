@@ -0,0 +1,101 @@
+/*
+ * @file strbench.c
+ * @brief Microbenchmark: lib string primitives against glibc.
+ *
+ * Runs every primitive over a set of short strings (d_name sized, 4..24
+ * bytes) and over long strings (4 KiB), and prints ns per call for both the
+ * gui* function and its glibc counterpart. Unlike the tools, this program
+ * links libc on purpose, for the reference implementations and the clock.
+ *
+ * Build and run with: make bench
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lib.h"
+
+#define SHORT_COUNT 4096
+#define LONG_LEN 4096
+#define LONG_COUNT 16
+
+typedef struct {
+  char **a;
+  char **b; // Same contents as 'a' in separate memory, last byte changed.
+  size_t count;
+  size_t iters;
+  const char *label;
+} Set;
+
+static volatile size_t sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static Set make_set(const char *label, size_t count, size_t min, size_t max,
+                    size_t iters) {
+  Set s = {malloc(count * sizeof(char *)), malloc(count * sizeof(char *)),
+           count, iters, label};
+  for (size_t i = 0; i < count; ++i) {
+    size_t len = min + (size_t)rand() % (max - min + 1);
+    // Odd offsets so the strings are not conveniently aligned.
+    s.a[i] = (char *)malloc(len + 8) + (i & 7);
+    s.b[i] = (char *)malloc(len + 8) + ((i * 3) & 7);
+    for (size_t j = 0; j < len; ++j) {
+      s.a[i][j] = 'a' + (char)(rand() % 26);
+    }
+    s.a[i][len] = '\0';
+    memcpy(s.b[i], s.a[i], len + 1);
+    s.b[i][len - 1] ^= 1;
+  }
+  return s;
+}
+
+#define BENCH(name, set, expr)                                                 \
+  do {                                                                         \
+    size_t acc = 0;                                                            \
+    double t0 = now_ns();                                                      \
+    for (size_t it = 0; it < (set)->iters; ++it) {                             \
+      for (size_t i = 0; i < (set)->count; ++i) {                              \
+        const char *A = (set)->a[i];                                           \
+        const char *B = (set)->b[i];                                           \
+        (void)B;                                                               \
+        acc += (size_t)(expr);                                                 \
+      }                                                                        \
+    }                                                                          \
+    double t = (now_ns() - t0) / ((double)(set)->iters * (set)->count);        \
+    sink = acc;                                                                \
+    printf("  %-10s %-6s %9.2f ns\n", name, (set)->label, t);                  \
+  } while (0)
+
+static void run(Set *s) {
+  static char dst[LONG_LEN * 2 + 64];
+
+  BENCH("guilen", s, guilen(A));
+  BENCH("strlen", s, strlen(A));
+  BENCH("guinlen", s, guinlen(A, 64));
+  BENCH("strnlen", s, strnlen(A, 64));
+  BENCH("guicmp", s, guicmp(A, B));
+  BENCH("strcmp", s, strcmp(A, B));
+  BENCH("guincmp", s, guincmp(A, B, 4096));
+  BENCH("strncmp", s, strncmp(A, B, 4096));
+  BENCH("guicat", s, (dst[0] = '\0', guicat(guicat(dst, A), B)[0]));
+  BENCH("strcat", s, (dst[0] = '\0', strcat(strcat(dst, A), B)[0]));
+}
+
+int main(void) {
+  srand(1);
+  Set short_set = make_set("short", SHORT_COUNT, 4, 24, 2000);
+  Set long_set = make_set("long", LONG_COUNT, LONG_LEN, LONG_LEN, 20000);
+
+  printf("string primitives, ns per call (lower is better)\n");
+  run(&short_set);
+  run(&long_set);
+  return 0;
+}
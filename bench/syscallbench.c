@@ -0,0 +1,64 @@
+/*
+ * @file syscallbench.c
+ * @brief Microbenchmark: inline guicall() against out-of-line syscalls.
+ *
+ * Times a cheap system call (getppid) and a 1-byte read from /dev/zero
+ * through the inline guicall() wrappers, through an out-of-line function
+ * that loads all six argument registers (what guicall() used to expand
+ * to), and through glibc's syscall(), and prints ns per call. The kernel
+ * entry dominates; the difference is the call overhead around it.
+ *
+ * Build and run with: make bench
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "sys/guicall.h"
+
+#define ITERS 2000000
+
+static volatile long sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+__attribute__((noinline)) static int64_t
+outofline(int64_t num, int64_t a1, int64_t a2, int64_t a3, int64_t a4,
+          int64_t a5, int64_t a6) {
+  return _guicall6(num, a1, a2, a3, a4, a5, a6);
+}
+
+#define BENCH(name, expr)                                                      \
+  do {                                                                         \
+    long acc = 0;                                                              \
+    double t0 = now_ns();                                                      \
+    for (int i = 0; i < ITERS; ++i) {                                          \
+      acc += (expr);                                                           \
+    }                                                                          \
+    sink = acc;                                                                \
+    printf("  %-10s %7.2f ns\n", name, (now_ns() - t0) / ITERS);               \
+  } while (0)
+
+int main(void) {
+  char byte;
+  int fd = open("/dev/zero", O_RDONLY);
+
+  printf("getppid:\n");
+  BENCH("syscall", syscall(SYS_getppid));
+  BENCH("noinline", outofline(SYS_getppid, 0, 0, 0, 0, 0, 0));
+  BENCH("guicall", guicall(SYS_getppid));
+
+  printf("read 1 byte:\n");
+  BENCH("syscall", syscall(SYS_read, fd, &byte, 1));
+  BENCH("noinline", outofline(SYS_read, fd, (int64_t)&byte, 1, 0, 0, 0));
+  BENCH("guicall", guicall(SYS_read, fd, &byte, 1));
+  return 0;
+}
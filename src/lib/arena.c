@@ -0,0 +1,146 @@
+/*
+ * @file arena.c
+ * @brief mmap-backed bump allocator and fixed-size block pool (see arena.h).
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/mman.h>
+#include <stdint.h>
+#include "arena.h"
+#include "sys/guicall.h"
+#include "sys/sysnums.h"
+
+#define ARENA_DEFAULT_CHUNK (1024 * 64)
+#define ARENA_MAX_CHUNK (1024 * 1024 * 64)
+#define ARENA_PAGE 4096
+#define ARENA_HUGE_PAGE (1024 * 1024 * 2)
+
+#define ARENA_HEADER                                                           \
+  ((sizeof(gui_arena_chunk) + GUI_ARENA_ALIGN - 1) &                           \
+   ~(size_t)(GUI_ARENA_ALIGN - 1))
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+
+void gui_arena_init(gui_arena *arena, size_t chunk_size, int flags) {
+  arena->ptr = NULL;
+  arena->end = NULL;
+  arena->chunk = NULL;
+  arena->spare = NULL;
+  arena->next_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+  arena->flags = flags;
+}
+
+static void chunk_unmap(gui_arena_chunk *chunk) {
+  guicall(SYS_munmap, chunk, chunk->size);
+}
+
+/**
+ * @brief Maps a chunk of 'size' bytes, on huge pages when the arena asks for
+ * them and the chunk is big enough to fill at least one.
+ */
+
+static gui_arena_chunk *chunk_map(gui_arena *arena, size_t size) {
+  int64_t mem = -ENOMEM;
+  int huge = (arena->flags & GUI_ARENA_HUGE) && size >= ARENA_HUGE_PAGE;
+
+  size = (size + ARENA_PAGE - 1) & ~(size_t)(ARENA_PAGE - 1);
+  if (huge) {
+    size = (size + ARENA_HUGE_PAGE - 1) & ~(size_t)(ARENA_HUGE_PAGE - 1);
+    // Fails unless the administrator reserved pages (vm.nr_hugepages).
+    mem = guicall(SYS_mmap, NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+  }
+  if (mem < 0) {
+    mem = guicall(SYS_mmap, NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (mem < 0) {
+      return NULL;
+    }
+    if (huge) {
+      guicall(SYS_madvise, mem, size, MADV_HUGEPAGE);
+    }
+  }
+
+  gui_arena_chunk *chunk = (gui_arena_chunk *)mem;
+  chunk->size = size;
+  return chunk;
+}
+
+/**
+ * @brief Out-of-line half of gui_arena_alloc(): starts a new chunk, taking
+ * the spare one when it is large enough.
+ */
+
+void *gui_arena_alloc_slow(gui_arena *arena, size_t size) {
+  gui_arena_chunk *chunk = arena->spare;
+  if (chunk != NULL && chunk->size - ARENA_HEADER >= size) {
+    arena->spare = NULL;
+  } else {
+    size_t chunk_size = arena->next_size;
+    while (chunk_size - ARENA_HEADER < size) {
+      chunk_size *= 2;
+    }
+    chunk = chunk_map(arena, chunk_size);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    if (arena->next_size < ARENA_MAX_CHUNK) {
+      arena->next_size *= 2;
+    }
+  }
+
+  chunk->prev = arena->chunk;
+  arena->chunk = chunk;
+  arena->ptr = (char *)chunk + ARENA_HEADER + size;
+  arena->end = (char *)chunk + chunk->size;
+  return (char *)chunk + ARENA_HEADER;
+}
+
+/**
+ * @brief Releases everything allocated after 'mark' was taken. The largest
+ * released chunk is kept as the spare for the next growth.
+ */
+
+void gui_arena_rewind(gui_arena *arena, gui_arena_mark mark) {
+  while (arena->chunk != mark.chunk) {
+    gui_arena_chunk *chunk = arena->chunk;
+    arena->chunk = chunk->prev;
+    if (arena->spare == NULL) {
+      arena->spare = chunk;
+    } else if (chunk->size > arena->spare->size) {
+      chunk_unmap(arena->spare);
+      arena->spare = chunk;
+    } else {
+      chunk_unmap(chunk);
+    }
+  }
+
+  arena->ptr = mark.ptr;
+  arena->end = mark.chunk ? (char *)mark.chunk + mark.chunk->size : NULL;
+}
+
+void gui_arena_free(gui_arena *arena) {
+  gui_arena_reset(arena);
+  if (arena->spare != NULL) {
+    chunk_unmap(arena->spare);
+    arena->spare = NULL;
+  }
+}
+
+void gui_pool_init(gui_pool *pool, size_t block_size) {
+  pool->block_size = block_size < sizeof(void *) ? sizeof(void *) : block_size;
+  pool->free = NULL;
+  // Enough for a few blocks per chunk; later chunks double as usual.
+  gui_arena_init(&pool->arena, 4 * (pool->block_size + ARENA_HEADER), 0);
+}
+
+void gui_pool_free(gui_pool *pool) {
+  gui_arena_free(&pool->arena);
+  pool->free = NULL;
+}
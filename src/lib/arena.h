@@ -0,0 +1,115 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bump allocator over mmap'd chunks.
+ *
+ * Allocation is a pointer increment; nothing is freed individually.
+ * Instead, a mark taken before some work releases everything allocated
+ * after it in one step:
+ *
+ *   gui_arena_mark mark = gui_arena_save(&arena);
+ *   ... gui_arena_alloc(&arena, n) per entry ...
+ *   gui_arena_rewind(&arena, mark);
+ *
+ * Chunks double in size as the arena grows. The most recently released
+ * chunk is kept as a spare, so a rewind/refill cycle (one per directory in
+ * a recursive listing) settles into zero mmap/munmap calls. With
+ * GUI_ARENA_HUGE, chunks of 2 MiB and up are backed by huge pages: explicit
+ * MAP_HUGETLB pages when the system has some reserved, transparent huge
+ * pages (MADV_HUGEPAGE) otherwise.
+ *
+ * An arena (and a pool) belongs to one thread.
+ */
+
+#define GUI_ARENA_HUGE 1
+
+#define GUI_ARENA_ALIGN 16
+
+typedef struct gui_arena_chunk {
+  struct gui_arena_chunk *prev;
+  size_t size; // Whole mapping, header included.
+} gui_arena_chunk;
+
+typedef struct gui_arena {
+  char *ptr;
+  char *end;
+  gui_arena_chunk *chunk; // Current chunk; older ones hang off 'prev'.
+  gui_arena_chunk *spare;
+  size_t next_size;
+  int flags;
+} gui_arena;
+
+typedef struct gui_arena_mark {
+  gui_arena_chunk *chunk;
+  char *ptr;
+} gui_arena_mark;
+
+void gui_arena_init(gui_arena *arena, size_t chunk_size, int flags);
+void *gui_arena_alloc_slow(gui_arena *arena, size_t size);
+void gui_arena_rewind(gui_arena *arena, gui_arena_mark mark);
+void gui_arena_free(gui_arena *arena);
+
+/**
+ * @brief Allocates 'size' bytes aligned to GUI_ARENA_ALIGN.
+ * @return The memory, or NULL when no chunk could be mapped.
+ */
+
+static inline void *gui_arena_alloc(gui_arena *arena, size_t size) {
+  size = (size + GUI_ARENA_ALIGN - 1) & ~(size_t)(GUI_ARENA_ALIGN - 1);
+  if (size <= (size_t)(arena->end - arena->ptr)) {
+    void *mem = arena->ptr;
+    arena->ptr += size;
+    return mem;
+  }
+  return gui_arena_alloc_slow(arena, size);
+}
+
+static inline gui_arena_mark gui_arena_save(gui_arena *arena) {
+  gui_arena_mark mark = {arena->chunk, arena->ptr};
+  return mark;
+}
+
+static inline void gui_arena_reset(gui_arena *arena) {
+  gui_arena_mark empty = {NULL, NULL};
+  gui_arena_rewind(arena, empty);
+}
+
+/*
+ * Free-list pool of fixed-size blocks (getdents buffers and the like),
+ * carved from its own arena. Released blocks are reused before the arena
+ * grows, so a steady get/put pattern never maps memory again.
+ */
+
+typedef struct gui_pool {
+  size_t block_size;
+  void *free; // Released blocks, linked through their first word.
+  gui_arena arena;
+} gui_pool;
+
+void gui_pool_init(gui_pool *pool, size_t block_size);
+void gui_pool_free(gui_pool *pool);
+
+/**
+ * @brief Takes a block from the pool.
+ * @return The block, or NULL when no memory could be mapped.
+ */
+
+static inline void *gui_pool_get(gui_pool *pool) {
+  void *block = pool->free;
+  if (block != NULL) {
+    pool->free = *(void **)block;
+    return block;
+  }
+  return gui_arena_alloc(&pool->arena, pool->block_size);
+}
+
+static inline void gui_pool_put(gui_pool *pool, void *block) {
+  *(void **)block = pool->free;
+  pool->free = block;
+}
+
+#endif
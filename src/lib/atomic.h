@@ -0,0 +1,58 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+/*
+ * Shorthands for the GCC __atomic builtins, named after the ordering they
+ * use, for code shared between the threads of thread.h. They work on any
+ * integer or pointer lvalue, as the builtins do.
+ *
+ *   gui_atomic_add(&counter, 1);                 // relaxed
+ *   if (gui_atomic_load_acquire(&ready)) ...
+ *   gui_atomic_store_release(&ready, 1);
+ *   gui_atomic_cas(&state, &expected, desired)   // acq_rel, 1 on success
+ *
+ * Relaxed operations only make the access itself atomic; use the acquire
+ * and release forms whenever another variable is published through it.
+ */
+
+#define gui_atomic_load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define gui_atomic_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define gui_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define gui_atomic_store_release(p, v)                                         \
+  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+// Read-modify-write operations return the value after the operation.
+#define gui_atomic_add(p, v) __atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define gui_atomic_sub(p, v) __atomic_sub_fetch((p), (v), __ATOMIC_RELAXED)
+#define gui_atomic_add_acq_rel(p, v)                                           \
+  __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define gui_atomic_sub_acq_rel(p, v)                                           \
+  __atomic_sub_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define gui_atomic_exchange(p, v)                                              \
+  __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+
+/*
+ * Compare-and-swap: stores 'desired' if '*p' equals '*expected' and
+ * returns 1; otherwise loads '*p' into '*expected' and returns 0. The weak
+ * form may fail spuriously and belongs in a retry loop.
+ */
+#define gui_atomic_cas(p, expected, desired)                                   \
+  __atomic_compare_exchange_n((p), (expected), (desired), 0,                   \
+                              __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define gui_atomic_cas_weak(p, expected, desired)                              \
+  __atomic_compare_exchange_n((p), (expected), (desired), 1,                   \
+                              __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+
+// Sequentially consistent forms, for store-then-load handshakes (a waiter
+// announcing itself before sleeping, a waker checking for waiters).
+#define gui_atomic_add_seq_cst(p, v)                                           \
+  __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define gui_atomic_load_seq_cst(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+
+/**
+ * @brief Spin-wait hint: lets the sibling hyperthread run and saves power.
+ */
+
+static inline void gui_cpu_relax(void) { __asm__ volatile("pause"); }
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * @file conv.c
+ * @brief String to number conversions (guitol, guitoi and the bounded
+ * guintol/guintoi), with a vectorized decimal path.
+ *
+ * Decimal digits are consumed a chunk at a time instead of one by one:
+ *
+ *  - SWAR: one 8 byte load, a test that counts how many leading bytes are
+ *    digits, and three multiplies that combine them into a value. A chunk
+ *    with fewer than eight digits is shifted towards the top of the word
+ *    first, so the missing positions read as leading zeros.
+ *  - SSE4.1: the same for 16 bytes, with a shuffle for the shift and
+ *    multiply-adds pairing digits into 2, 4 and 8 digit groups.
+ *
+ * Overflow is checked once per chunk on an unsigned accumulator. Other
+ * bases, and the few bytes left before the end of a slice or a page, go
+ * through the plain per-digit loop; so does a chunk that overflows, to
+ * find the digit where parsing stops.
+ *
+ * guitol/guitoi read NUL-terminated strings, so like guilen they only load
+ * a chunk when it does not cross into the next page; the NUL simply ends
+ * the run of digits. The bounded variants also load whole chunks near the
+ * end of the slice as long as they stay on a mapped page, but never use
+ * the bytes after 'str + len'.
+ *
+ * The SSE4.1 kernel is picked at first use, like the ones in str.c.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "lib.h"
+
+#define LOW_LEVEL_LONG_MAX 9223372036854775807L       // 2^63 - 1
+#define LOW_LEVEL_LONG_MIN (-LOW_LEVEL_LONG_MAX - 1L) // -2^63
+
+#define PAGE_SIZE 4096
+
+#define SWAR_ZEROS 0x3030303030303030ULL
+#define SWAR_LOWS 0x7f7f7f7f7f7f7f7fULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+
+typedef uint64_t u64_u __attribute__((aligned(1), may_alias));
+
+typedef unsigned (*dec16_fn)(const unsigned char *p, unsigned max,
+                             uint64_t *value);
+
+static unsigned dec16_resolve(const unsigned char *p, unsigned max,
+                              uint64_t *value);
+
+static dec16_fn _dec16_impl = dec16_resolve;
+
+static const uint64_t pow10[17] = {1ULL,
+                                   10ULL,
+                                   100ULL,
+                                   1000ULL,
+                                   10000ULL,
+                                   100000ULL,
+                                   1000000ULL,
+                                   10000000ULL,
+                                   100000000ULL,
+                                   1000000000ULL,
+                                   10000000000ULL,
+                                   100000000000ULL,
+                                   1000000000000ULL,
+                                   10000000000000ULL,
+                                   100000000000000ULL,
+                                   1000000000000000ULL,
+                                   10000000000000000ULL};
+
+/*
+ * =========
+ * =Helpers=
+ * =========
+ */
+
+/**
+ * @brief The byte at 'p', or 0 at the end of a bounded slice ('end' is NULL
+ * for NUL-terminated strings).
+ */
+
+static inline int peek(const unsigned char *p, const unsigned char *end) {
+  return end != NULL && p >= end ? 0 : *p;
+}
+
+/**
+ * @brief Whether 'n' bytes starting at 'p' may be loaded at once: they are
+ * all inside the slice, or at least all on the page of 'p', which is
+ * mapped. Bytes loaded past the end of a slice are never used.
+ */
+
+static inline int can_load(const unsigned char *p, const unsigned char *end,
+                           size_t n) {
+  if (end != NULL && (size_t)(end - p) >= n) {
+    return 1;
+  }
+  return ((uintptr_t)p & (PAGE_SIZE - 1)) <= PAGE_SIZE - n;
+}
+
+static inline int is_space(int c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * @brief Value of 'c' as a digit in bases up to 36, or 36 if it is none.
+ */
+
+static inline unsigned digit_value(int c) {
+  if ((unsigned)(c - '0') < 10) {
+    return (unsigned)(c - '0');
+  }
+  c |= 0x20; // ASCII lower case.
+  if ((unsigned)(c - 'a') < 26) {
+    return (unsigned)(c - 'a') + 10;
+  }
+  return 36;
+}
+
+/**
+ * @brief Folds an 'n' digit chunk into the accumulator.
+ * @return 0, or 1 (leaving '*acc' as it was) if the value would pass
+ * 'limit'.
+ */
+
+static inline int accumulate(uint64_t *acc, uint64_t limit, uint64_t chunk,
+                             unsigned n) {
+  uint64_t v;
+  if (__builtin_mul_overflow(*acc, pow10[n], &v) ||
+      __builtin_add_overflow(v, chunk, &v) || v > limit) {
+    return 1;
+  }
+  *acc = v;
+  return 0;
+}
+
+/*
+ * ===============
+ * =Digit kernels=
+ * ===============
+ */
+
+/**
+ * @brief Number of leading decimal digits among the 8 bytes of 'w' (first
+ * byte in the low bits).
+ */
+
+static inline unsigned swar_count(uint64_t w) {
+  // Digits become 0..9; a byte is anything else iff adding 0x76 to its low
+  // seven bits carries into bit 7, or bit 7 was already set.
+  uint64_t x = w ^ SWAR_ZEROS;
+  uint64_t bad = (((x & SWAR_LOWS) + 0x7676767676767676ULL) | x) & SWAR_HIGHS;
+  return bad ? (unsigned)__builtin_ctzll(bad) >> 3 : 8;
+}
+
+/**
+ * @brief Value of the first 'n' (1..8) digits of 'w'.
+ */
+
+static inline uint64_t swar_value(uint64_t w, unsigned n) {
+  w = (w & 0x0f0f0f0f0f0f0f0fULL) << (8 * (8 - n));
+  w = (w * 10 + (w >> 8)) & 0x00ff00ff00ff00ffULL;
+  w = (w * 100 + (w >> 16)) & 0x0000ffff0000ffffULL;
+  return (w * 10000 + (w >> 32)) & 0xffffffffULL;
+}
+
+/**
+ * @brief Counts the leading digits of the 16 bytes at 'p', at most 'max'
+ * of them, and stores their value. Fallback for CPUs without SSE4.1: two
+ * SWAR steps.
+ */
+
+static unsigned dec16_swar(const unsigned char *p, unsigned max,
+                           uint64_t *value) {
+  uint64_t w = *(const u64_u *)p;
+  unsigned n = swar_count(w);
+  if (n > max) {
+    n = max;
+  }
+  if (n < 8) {
+    *value = n ? swar_value(w, n) : 0;
+    return n;
+  }
+  uint64_t hi = swar_value(w, 8);
+  w = *(const u64_u *)(p + 8);
+  n = swar_count(w);
+  if (n > max - 8) {
+    n = max - 8;
+  }
+  *value = n ? hi * pow10[n] + swar_value(w, n) : hi;
+  return 8 + n;
+}
+
+__attribute__((target("sse4.1"))) static unsigned
+dec16_sse41(const unsigned char *p, unsigned max, uint64_t *value) {
+  // Row 'n' (read at offset n) moves the first n bytes to the end of the
+  // vector and zeroes the rest, which then count as leading zeros.
+  static const unsigned char shift[32] = {
+      0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x80, 0,    1,    2,    3,    4,    5,
+      6,    7,    8,    9,    10,   11,   12,   13,   14,   15};
+
+  __m128i d = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)p),
+                           _mm_set1_epi8('0'));
+  __m128i nine = _mm_set1_epi8(9);
+  unsigned digits = (unsigned)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_max_epu8(d, nine), nine));
+  unsigned n = (unsigned)__builtin_ctz(~digits);
+  if (n > max) {
+    n = max;
+  }
+  if (n == 0) {
+    *value = 0;
+    return 0;
+  }
+
+  d = _mm_shuffle_epi8(d, _mm_loadu_si128((const __m128i *)(shift + n)));
+  d = _mm_maddubs_epi16(d, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1,
+                                         10, 1, 10, 1, 10, 1));
+  d = _mm_madd_epi16(d, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+  d = _mm_packus_epi32(d, d);
+  d = _mm_madd_epi16(d, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000,
+                                       1));
+  uint64_t hi = (uint32_t)_mm_cvtsi128_si32(d);
+  uint64_t lo = (uint32_t)_mm_extract_epi32(d, 1);
+  *value = hi * 100000000ULL + lo;
+  return n;
+}
+
+static unsigned dec16_resolve(const unsigned char *p, unsigned max,
+                              uint64_t *value) {
+  _dec16_impl =
+      (gui_cpu_features() & GUI_CPU_SSE41) ? dec16_sse41 : dec16_swar;
+  return _dec16_impl(p, max, value);
+}
+
+/*
+ * ==============================
+ * =String to number conversions=
+ * ==============================
+ */
+
+/**
+ * @brief Per-digit loop for any base, continuing from 'acc'.
+ * @return The first byte that is not a digit in 'base', or the digit that
+ * would take the value past 'limit' (with '*overflow' set).
+ */
+
+static const unsigned char *scan_digits(const unsigned char *p,
+                                        const unsigned char *end,
+                                        unsigned base, uint64_t limit,
+                                        uint64_t *acc, int *overflow) {
+  uint64_t cutoff = limit / base;
+  unsigned cutlim = (unsigned)(limit % base);
+  unsigned d;
+  while ((d = digit_value(peek(p, end))) < base) {
+    if (*acc > cutoff || (*acc == cutoff && d > cutlim)) {
+      *overflow = 1;
+      return p;
+    }
+    *acc = *acc * base + d;
+    ++p;
+  }
+  return p;
+}
+
+/**
+ * @brief Base 10 digits, 16 or 8 at a time while chunks can be loaded, the
+ * rest one by one.
+ */
+
+static const unsigned char *scan_decimal(const unsigned char *p,
+                                         const unsigned char *end,
+                                         uint64_t limit, uint64_t *acc,
+                                         int *overflow) {
+  for (;;) {
+    size_t left = end != NULL ? (size_t)(end - p) : 16;
+    unsigned max = left < 16 ? (unsigned)left : 16;
+    uint64_t chunk = 0;
+    unsigned n;
+
+    if (max == 0) {
+      return p;
+    }
+    if (can_load(p, end, 16)) {
+      n = _dec16_impl(p, max, &chunk);
+    } else if (can_load(p, end, 8)) {
+      uint64_t w = *(const u64_u *)p;
+      max = max < 8 ? max : 8;
+      n = swar_count(w);
+      n = n < max ? n : max;
+      if (n != 0) {
+        chunk = swar_value(w, n);
+      }
+    } else {
+      return scan_digits(p, end, 10, limit, acc, overflow);
+    }
+
+    if (n != 0) {
+      if (accumulate(acc, limit, chunk, n)) {
+        // Redo the chunk digit by digit to stop at the one that overflows.
+        return scan_digits(p, end, 10, limit, acc, overflow);
+      }
+      p += n;
+    }
+    if (n < max) {
+      return p;
+    }
+  }
+}
+
+/**
+ * @brief Shared body of guitol and guintol; 'end' is NULL for a
+ * NUL-terminated 'str'.
+ */
+
+static long convert(const char *str, const char *end_, char **endptr,
+                    int base) {
+  const unsigned char *p = (const unsigned char *)str;
+  const unsigned char *end = (const unsigned char *)end_;
+  int negative = 0;
+
+  while (is_space(peek(p, end))) {
+    p++;
+  }
+
+  if (peek(p, end) == '-') {
+    negative = 1;
+    p++;
+  } else if (peek(p, end) == '+') {
+    p++;
+  }
+
+  if ((base == 0 || base == 16) && peek(p, end) == '0' &&
+      (peek(p + 1, end) | 0x20) == 'x') {
+    base = 16;
+    p += 2;
+  } else if (base == 0) {
+    base = peek(p, end) == '0' ? 8 : 10;
+  }
+
+  if (base < 2 || base > 36) {
+    if (endptr)
+      *endptr = (char *)str;
+    return 0;
+  }
+
+  uint64_t limit = negative ? (uint64_t)LOW_LEVEL_LONG_MAX + 1
+                            : (uint64_t)LOW_LEVEL_LONG_MAX;
+  uint64_t acc = 0;
+  int overflow = 0;
+
+  if (base == 10) {
+    p = scan_decimal(p, end, limit, &acc, &overflow);
+  } else {
+    p = scan_digits(p, end, (unsigned)base, limit, &acc, &overflow);
+  }
+
+  if (endptr) {
+    *endptr = (char *)p;
+  }
+
+  if (overflow) {
+    return negative ? LOW_LEVEL_LONG_MIN : LOW_LEVEL_LONG_MAX;
+  }
+
+  return negative ? (long)-acc : (long)acc;
+}
+
+/**
+ * @brief converts a string to a 'long'.
+ *
+ * (Like strtol, but errno is never written: on overflow the result
+ * saturates and '*endptr' points at the digit that overflowed. When no
+ * digit is found, '*endptr' points past the blanks, sign and "0x" prefix.)
+ */
+
+long guitol(const char *str, char **endptr, int base) {
+  return convert(str, NULL, endptr, base);
+}
+
+/**
+ * @brief Like guitol, for the 'len' bytes at 'str', which need not be
+ * NUL-terminated (a field in an mmap'd file, say).
+ */
+
+long guintol(const char *str, size_t len, char **endptr, int base) {
+  return convert(str, str + len, endptr, base);
+}
+
+/**
+ * @brief converts a string to a 'int'.
+ * (Equivalent to atoi, unsing guitol)
+ */
+
+int guitoi(const char *str) { return (int)guitol(str, NULL, 10); }
+
+int guintoi(const char *str, size_t len) {
+  return (int)guintol(str, len, NULL, 10);
+}
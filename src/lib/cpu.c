@@ -0,0 +1,92 @@
+/*
+ * @file cpu.c
+ * @brief cpuid based feature detection for the dispatching kernels in mem.c
+ * and friends.
+ *
+ * @license MIT
+ */
+
+#include <cpuid.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Not named by every <cpuid.h> version.
+#define CPUID7_EBX_ERMS (1u << 9)
+#define CPUID7_EDX_FSRM (1u << 4)
+
+#define XCR0_SSE (1u << 1)
+#define XCR0_AVX (1u << 2)
+#define XCR0_OPMASK (1u << 5)
+#define XCR0_ZMM_HI256 (1u << 6)
+#define XCR0_HI16_ZMM (1u << 7)
+
+static unsigned _features;
+static int _detected;
+
+static uint64_t xgetbv0(void) {
+  uint32_t lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * @brief Queries cpuid once and caches the result. AVX2 and AVX-512 are only
+ * reported when the kernel also saves the corresponding register state
+ * (OSXSAVE + XCR0), otherwise using them would fault.
+ */
+
+static unsigned detect(void) {
+  unsigned eax, ebx, ecx, edx;
+  unsigned f = GUI_CPU_SSE2; // Baseline for x86-64.
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return f;
+  }
+  if (ecx & bit_SSE4_1) {
+    f |= GUI_CPU_SSE41;
+  }
+
+  uint64_t xcr0 = 0;
+  if (ecx & bit_OSXSAVE) {
+    xcr0 = xgetbv0();
+  }
+  int ymm_ok = (xcr0 & (XCR0_SSE | XCR0_AVX)) == (XCR0_SSE | XCR0_AVX);
+  int zmm_ok = ymm_ok && (xcr0 & (XCR0_OPMASK | XCR0_ZMM_HI256 |
+                                  XCR0_HI16_ZMM)) ==
+                             (XCR0_OPMASK | XCR0_ZMM_HI256 | XCR0_HI16_ZMM);
+
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    if ((ebx & bit_AVX2) && ymm_ok) {
+      f |= GUI_CPU_AVX2;
+    }
+    if ((ebx & bit_AVX512F) && (ebx & bit_AVX512BW) && zmm_ok) {
+      f |= GUI_CPU_AVX512;
+    }
+    if (ebx & bit_BMI2) {
+      f |= GUI_CPU_BMI2;
+    }
+    if (ebx & CPUID7_EBX_ERMS) {
+      f |= GUI_CPU_ERMS;
+    }
+    if (edx & CPUID7_EDX_FSRM) {
+      f |= GUI_CPU_FSRM;
+    }
+  }
+
+  if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (ecx & bit_LZCNT)) {
+    f |= GUI_CPU_LZCNT;
+  }
+  return f;
+}
+
+/**
+ * @brief Returns the GUI_CPU_* feature bits of the running CPU.
+ */
+
+unsigned gui_cpu_features(void) {
+  if (!_detected) {
+    _features = detect();
+    _detected = 1;
+  }
+  return _features;
+}
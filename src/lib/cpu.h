@@ -0,0 +1,21 @@
+#ifndef CPU_H
+#define CPU_H
+
+/*
+ * Runtime CPU feature detection. The library picks its vectorized kernels
+ * from these bits at startup so a single binary runs at full speed on every
+ * x86-64 machine instead of depending on -march=native at build time.
+ */
+
+#define GUI_CPU_SSE2 (1u << 0)
+#define GUI_CPU_SSE41 (1u << 1)
+#define GUI_CPU_AVX2 (1u << 2)
+#define GUI_CPU_AVX512 (1u << 3) // AVX-512 F + BW, with zmm state enabled by the OS
+#define GUI_CPU_ERMS (1u << 4)
+#define GUI_CPU_FSRM (1u << 5)
+#define GUI_CPU_BMI2 (1u << 6)
+#define GUI_CPU_LZCNT (1u << 7)
+
+unsigned gui_cpu_features(void);
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * @file deque.c
+ * @brief Chase-Lev work-stealing deque (see deque.h).
+ *
+ * The memory orderings follow the C11 version of the algorithm by Le,
+ * Pop, Cohen and Zappa Nardelli.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/mman.h>
+#include <stdint.h>
+#include "deque.h"
+#include "lib.h"
+#include "sys/guicall.h"
+#include "sys/sysnums.h"
+
+#define DEQUE_INITIAL_SLOTS 1024
+
+static gui_deque_ring *ring_new(int64_t slots) {
+  size_t size = sizeof(gui_deque_ring) + (size_t)slots * sizeof(void *);
+  int64_t mem = guicall(SYS_mmap, NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (mem < 0) {
+    return NULL;
+  }
+  gui_deque_ring *ring = (gui_deque_ring *)mem;
+  ring->prev = NULL;
+  ring->map_size = size;
+  ring->mask = slots - 1;
+  return ring;
+}
+
+int gui_deque_init(gui_deque *deque) {
+  deque->top = 0;
+  deque->bottom = 0;
+  deque->ring = ring_new(DEQUE_INITIAL_SLOTS);
+  return deque->ring != NULL ? 0 : -ENOMEM;
+}
+
+void gui_deque_destroy(gui_deque *deque) {
+  gui_deque_ring *ring = deque->ring;
+  while (ring != NULL) {
+    gui_deque_ring *prev = ring->prev;
+    guicall(SYS_munmap, ring, ring->map_size);
+    ring = prev;
+  }
+  deque->ring = NULL;
+}
+
+/**
+ * @brief Doubles the ring, copying the live range [top, bottom). Owner only.
+ */
+
+static gui_deque_ring *grow(gui_deque *deque, gui_deque_ring *old, int64_t top,
+                            int64_t bottom) {
+  gui_deque_ring *ring = ring_new((old->mask + 1) * 2);
+  if (ring == NULL) {
+    return NULL;
+  }
+  for (int64_t i = top; i < bottom; ++i) {
+    ring->slots[i & ring->mask] = old->slots[i & old->mask];
+  }
+  ring->prev = old;
+  __atomic_store_n(&deque->ring, ring, __ATOMIC_RELEASE);
+  return ring;
+}
+
+/**
+ * @brief Pushes 'item' at the bottom. Owner only.
+ * @return 0, or -ENOMEM when the ring had to grow and could not.
+ */
+
+int gui_deque_push(gui_deque *deque, void *item) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  gui_deque_ring *ring = __atomic_load_n(&deque->ring, __ATOMIC_RELAXED);
+  if (bottom - top > ring->mask) {
+    ring = grow(deque, ring, top, bottom);
+    if (ring == NULL) {
+      return -ENOMEM;
+    }
+  }
+  __atomic_store_n(&ring->slots[bottom & ring->mask], item, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/**
+ * @brief Pops the most recently pushed item. Owner only.
+ * @return The item, or NULL when the deque is empty.
+ */
+
+void *gui_deque_take(gui_deque *deque) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  gui_deque_ring *ring = __atomic_load_n(&deque->ring, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  void *item = NULL;
+  if (top <= bottom) {
+    item = __atomic_load_n(&ring->slots[bottom & ring->mask], __ATOMIC_RELAXED);
+    if (top == bottom) {
+      // Last item: race the thieves for it.
+      if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        item = NULL;
+      }
+      __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+  } else {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+  return item;
+}
+
+/**
+ * @brief Steals the oldest item. Any thread.
+ * @return The item, or NULL when the deque is empty or another thread won
+ * the race for it.
+ */
+
+void *gui_deque_steal(gui_deque *deque) {
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) {
+    return NULL;
+  }
+  gui_deque_ring *ring = __atomic_load_n(&deque->ring, __ATOMIC_ACQUIRE);
+  void *item = __atomic_load_n(&ring->slots[top & ring->mask], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+  return item;
+}
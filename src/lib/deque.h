@@ -0,0 +1,36 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Chase-Lev work-stealing deque of pointers (Le et al., "Correct and
+ * Efficient Work-Stealing for Weak Memory Models", PPoPP 2013).
+ *
+ * The owning thread pushes and takes at the bottom (LIFO); any other thread
+ * may steal from the top (FIFO). The ring grows on demand; replaced rings
+ * stay mapped until gui_deque_destroy() because a thief may still be reading
+ * from one.
+ */
+
+typedef struct gui_deque_ring {
+  struct gui_deque_ring *prev;
+  size_t map_size;
+  int64_t mask;
+  void *slots[];
+} gui_deque_ring;
+
+typedef struct gui_deque {
+  int64_t top __attribute__((aligned(64)));
+  int64_t bottom __attribute__((aligned(64)));
+  gui_deque_ring *ring;
+} gui_deque;
+
+int gui_deque_init(gui_deque *deque);
+void gui_deque_destroy(gui_deque *deque);
+int gui_deque_push(gui_deque *deque, void *item);
+void *gui_deque_take(gui_deque *deque);
+void *gui_deque_steal(gui_deque *deque);
+
+#endif
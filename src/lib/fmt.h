@@ -0,0 +1,26 @@
+#ifndef FMT_H
+#define FMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Number formatting into caller buffers. Nothing here allocates or makes a
+ * syscall, and nothing NUL-terminates: every function returns the number of
+ * bytes it wrote. Sizes that always suffice:
+ *
+ *   gui_fmt_u64 20, gui_fmt_i64 20, gui_fmt_hex 16, gui_fmt_oct 22,
+ *   gui_fmt_human 5 (e.g. "1023", "9.9K", "1023M").
+ */
+
+#define GUI_FMT_MAX 24
+
+unsigned gui_fmt_digits(uint64_t v);
+size_t gui_fmt_u64(char *buf, uint64_t v);
+size_t gui_fmt_i64(char *buf, int64_t v);
+size_t gui_fmt_hex(char *buf, uint64_t v);
+size_t gui_fmt_oct(char *buf, uint64_t v);
+size_t gui_fmt_human(char *buf, uint64_t bytes);
+size_t gui_fmt_pad(char *buf, const char *src, size_t len, size_t width);
+
+#endif
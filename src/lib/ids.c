@@ -0,0 +1,243 @@
+/*
+ * @file ids.c
+ * @brief Lazily parsed, cached uid/gid to name tables (see ids.h).
+ *
+ * Both files share the layout "name:password:id:...", one entry per line.
+ * When an id appears on several lines the first one wins, as with
+ * getpwuid(). Lines that do not parse (comments, NIS "+" entries, ids out
+ * of range) are skipped.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <linux/mman.h>
+#include <stdint.h>
+#include "ids.h"
+#include "lib.h"
+#include "sys/guicall.h"
+#include "sys/sysnums.h"
+
+#define IDS_INITIAL_SLOTS 64
+
+#define IDS_UNMAPPED 0
+#define IDS_PARSING 1 // Mapped; lines from 'next' on are not cached yet.
+#define IDS_DONE 2    // Everything cached, or the file could not be read.
+
+#ifndef SEEK_END
+#define SEEK_END 2
+#endif
+
+void gui_ids_init(gui_ids *ids, const char *path) {
+  ids->path = path;
+  ids->data = NULL;
+  ids->size = 0;
+  ids->next = NULL;
+  ids->state = IDS_UNMAPPED;
+  ids->slots = NULL;
+  ids->mask = 0;
+  ids->used = 0;
+  gui_arena_init(&ids->arena, 0, 0);
+}
+
+void gui_ids_free(gui_ids *ids) {
+  if (ids->data != NULL) {
+    guicall(SYS_munmap, ids->data, ids->size);
+  }
+  gui_arena_free(&ids->arena);
+  gui_ids_init(ids, ids->path);
+}
+
+/*
+ * =======
+ * =Table=
+ * =======
+ */
+
+/**
+ * @brief The slot holding 'id', or the empty slot where it belongs.
+ */
+
+static gui_ids_slot *ids_find(gui_ids *ids, uint32_t id) {
+  size_t i = (size_t)((id * 0x9e3779b97f4a7c15ULL) >> 32) & ids->mask;
+  while (ids->slots[i].name != NULL && ids->slots[i].id != id) {
+    i = (i + 1) & ids->mask;
+  }
+  return &ids->slots[i];
+}
+
+/**
+ * @brief Switches to a table of 'count' slots, rehashing what is cached.
+ * The old table is left in the arena.
+ * @return 0 on success, -1 when no memory could be mapped.
+ */
+
+static int ids_resize(gui_ids *ids, size_t count) {
+  gui_ids_slot *old = ids->slots;
+  size_t old_count = old ? ids->mask + 1 : 0;
+
+  gui_ids_slot *slots = gui_arena_alloc(&ids->arena, count * sizeof(*slots));
+  if (slots == NULL) {
+    return -1;
+  }
+  guimemset(slots, 0, count * sizeof(*slots));
+  ids->slots = slots;
+  ids->mask = count - 1;
+
+  for (size_t i = 0; i < old_count; ++i) {
+    if (old[i].name != NULL) {
+      *ids_find(ids, old[i].id) = old[i];
+    }
+  }
+  return 0;
+}
+
+static int ids_insert(gui_ids *ids, uint32_t id, const char *name,
+                      uint32_t len) {
+  // Keep the load factor at or below one half so probes stay short.
+  if (2 * (ids->used + 1) > ids->mask + 1 &&
+      ids_resize(ids, 2 * (ids->mask + 1)) < 0) {
+    return -1;
+  }
+  gui_ids_slot *slot = ids_find(ids, id);
+  if (slot->name == NULL) {
+    slot->name = name;
+    slot->id = id;
+    slot->len = len;
+    ++ids->used;
+  }
+  return 0;
+}
+
+/*
+ * =========
+ * =Parsing=
+ * =========
+ */
+
+/**
+ * @brief Maps the file and sets up the table. Any failure leaves the
+ * resolver in the IDS_DONE state, where every id is unknown.
+ */
+
+static void ids_map(gui_ids *ids) {
+  ids->state = IDS_DONE;
+  if (ids_resize(ids, IDS_INITIAL_SLOTS) < 0) {
+    return;
+  }
+
+  int fd = guicall(SYS_openat, AT_FDCWD, ids->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  int64_t size = guicall(SYS_lseek, fd, 0, SEEK_END);
+  int64_t mem = -1;
+  if (size > 0) {
+    mem = guicall(SYS_mmap, NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  guicall(SYS_close, fd);
+  if (mem < 0) {
+    return;
+  }
+
+  ids->data = (const char *)mem;
+  ids->size = (size_t)size;
+  ids->next = ids->data;
+  ids->state = IDS_PARSING;
+}
+
+/**
+ * @brief Parses the line at 'ids->next' and moves past it.
+ * @return 1 with the entry in 'id', 'name' and 'len', or 0 for a line to
+ * skip.
+ */
+
+static int ids_parse_line(gui_ids *ids, uint32_t *id, const char **name,
+                          uint32_t *len) {
+  const char *p = ids->next;
+  const char *end = ids->data + ids->size;
+  const char *eol = p;
+  while (eol < end && *eol != '\n') {
+    ++eol;
+  }
+  ids->next = eol < end ? eol + 1 : end;
+
+  const char *field[3];
+  int fields = 0;
+  field[fields++] = p;
+  for (; p < eol && fields < 3; ++p) {
+    if (*p == ':') {
+      field[fields++] = p + 1;
+    }
+  }
+  if (fields < 3 || field[1] - 1 == field[0] || *field[0] == '+' ||
+      *field[0] == '-' || *field[0] == '#') {
+    return 0;
+  }
+
+  uint64_t value = 0;
+  const char *q = field[2];
+  for (; q < eol && *q != ':'; ++q) {
+    if ((unsigned)(*q - '0') >= 10 || value > UINT32_MAX / 10) {
+      return 0;
+    }
+    value = value * 10 + (unsigned)(*q - '0');
+  }
+  if (q == field[2] || value > UINT32_MAX) {
+    return 0;
+  }
+
+  *id = (uint32_t)value;
+  *name = field[0];
+  *len = (uint32_t)(field[1] - 1 - field[0]);
+  return 1;
+}
+
+/*
+ * ========
+ * =Lookup=
+ * ========
+ */
+
+/**
+ * @brief Name of 'id', with its length (it is not NUL-terminated) in 'len'.
+ * @return The name, or NULL when the file has no such id or cannot be read.
+ */
+
+const char *gui_ids_name(gui_ids *ids, uint32_t id, size_t *len) {
+  if (ids->state == IDS_UNMAPPED) {
+    ids_map(ids);
+  }
+  if (ids->slots == NULL) {
+    return NULL;
+  }
+
+  gui_ids_slot *slot = ids_find(ids, id);
+  if (slot->name != NULL) {
+    *len = slot->len;
+    return slot->name;
+  }
+
+  while (ids->state == IDS_PARSING) {
+    if (ids->next == ids->data + ids->size) {
+      ids->state = IDS_DONE;
+      break;
+    }
+    uint32_t line_id, line_len;
+    const char *name;
+    if (!ids_parse_line(ids, &line_id, &name, &line_len)) {
+      continue;
+    }
+    if (ids_insert(ids, line_id, name, line_len) < 0) {
+      ids->state = IDS_DONE;
+      break;
+    }
+    if (line_id == id) {
+      *len = line_len;
+      return name;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef IDS_H
+#define IDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+/*
+ * uid/gid to name resolution from /etc/passwd or /etc/group, without NSS.
+ *
+ * The file is mapped on the first lookup and never read again. Its lines
+ * are parsed only as far as a lookup needs: every line passed on the way is
+ * cached in an open-addressing table, so a listing of any size whose files
+ * belong to a handful of owners touches a handful of lines. Names point
+ * into the mapping and stay valid until gui_ids_free().
+ *
+ *   gui_ids users;
+ *   gui_ids_init(&users, GUI_IDS_PASSWD);
+ *   size_t len;
+ *   const char *name = gui_ids_name(&users, uid, &len); // NULL if unknown
+ *
+ * A resolver belongs to one thread, like an arena.
+ */
+
+#define GUI_IDS_PASSWD "/etc/passwd"
+#define GUI_IDS_GROUP "/etc/group"
+
+typedef struct gui_ids_slot {
+  const char *name; // NULL for an empty slot.
+  uint32_t id;
+  uint32_t len;
+} gui_ids_slot;
+
+typedef struct gui_ids {
+  const char *path;
+  const char *data; // The mapping, NULL until the first lookup.
+  size_t size;
+  const char *next; // First line not parsed yet.
+  int state;
+  gui_ids_slot *slots;
+  size_t mask;
+  size_t used;
+  gui_arena arena;
+} gui_ids;
+
+void gui_ids_init(gui_ids *ids, const char *path);
+const char *gui_ids_name(gui_ids *ids, uint32_t id, size_t *len);
+void gui_ids_free(gui_ids *ids);
+
+#endif
@@ -18,10 +18,14 @@ void *guimemcpy(void *dest, const void *src, size_t n);
 void *guimemset(void *s, int c, size_t n);
 int guimemcmp(const void *s1, const void *s2, size_t n);
 
+// strtol without errno: an overflow saturates and stops at the digit that
+// overflowed, an invalid base returns 0 with '*endptr' at 'str'.
 long guitol(const char *str, char **endptr, int base);
 int guitoi(const char *str);
+long guintol(const char *str, size_t len, char **endptr, int base);
+int guintoi(const char *str, size_t len);
 
-void gui_perror(const char *msg);
+void gui_perror(const char *msg, int errnum);
 const char *gui_strerror(int errnum);
 
 #endif
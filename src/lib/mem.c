@@ -0,0 +1,521 @@
+/*
+ * @file mem.c
+ * @brief Vectorized memory primitives (guimemcpy, guimemset, guimemcmp).
+ *
+ * Each primitive has SSE2, AVX2 and AVX-512 kernels. The kernel is chosen
+ * on first use from the cpuid bits in cpu.c, so the makefile does not need
+ * -march=native. Kernels handle unaligned heads and tails with overlapping
+ * unaligned accesses and run the main loop with aligned stores. On CPUs with
+ * ERMS, large copies and fills use 'rep movsb'/'rep stosb', which the
+ * microcode runs faster than any vector loop.
+ *
+ * @license MIT
+ */
+
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "lib.h"
+
+// Above this size 'rep movsb'/'rep stosb' wins on ERMS hardware.
+#define REP_THRESHOLD 2048
+// FSRM makes the rep-prefixed instructions cheap to start as well.
+#define REP_THRESHOLD_FSRM 1024
+
+typedef uint64_t u64_u __attribute__((aligned(1), may_alias));
+typedef uint32_t u32_u __attribute__((aligned(1), may_alias));
+typedef uint16_t u16_u __attribute__((aligned(1), may_alias));
+
+typedef void *(*memcpy_fn)(void *, const void *, size_t);
+typedef void *(*memset_fn)(void *, int, size_t);
+typedef int (*memcmp_fn)(const void *, const void *, size_t);
+
+static void *memcpy_resolve(void *dest, const void *src, size_t n);
+static void *memset_resolve(void *s, int c, size_t n);
+static int memcmp_resolve(const void *s1, const void *s2, size_t n);
+
+static memcpy_fn _memcpy_impl = memcpy_resolve;
+static memset_fn _memset_impl = memset_resolve;
+static memcmp_fn _memcmp_impl = memcmp_resolve;
+static size_t _rep_threshold = SIZE_MAX;
+
+/*
+ * =========================
+ * =Scalar helpers (< 16 B)=
+ * =========================
+ */
+
+static inline void copy_small(char *d, const char *s, size_t n) {
+  if (n >= 8) {
+    uint64_t a = *(const u64_u *)s;
+    uint64_t b = *(const u64_u *)(s + n - 8);
+    *(u64_u *)d = a;
+    *(u64_u *)(d + n - 8) = b;
+  } else if (n >= 4) {
+    uint32_t a = *(const u32_u *)s;
+    uint32_t b = *(const u32_u *)(s + n - 4);
+    *(u32_u *)d = a;
+    *(u32_u *)(d + n - 4) = b;
+  } else if (n >= 2) {
+    uint16_t a = *(const u16_u *)s;
+    uint16_t b = *(const u16_u *)(s + n - 2);
+    *(u16_u *)d = a;
+    *(u16_u *)(d + n - 2) = b;
+  } else if (n == 1) {
+    *d = *s;
+  }
+}
+
+static inline void set_small(char *d, unsigned char c, size_t n) {
+  uint64_t v = c * 0x0101010101010101ULL;
+  if (n >= 8) {
+    *(u64_u *)d = v;
+    *(u64_u *)(d + n - 8) = v;
+  } else if (n >= 4) {
+    *(u32_u *)d = (uint32_t)v;
+    *(u32_u *)(d + n - 4) = (uint32_t)v;
+  } else if (n >= 2) {
+    *(u16_u *)d = (uint16_t)v;
+    *(u16_u *)(d + n - 2) = (uint16_t)v;
+  } else if (n == 1) {
+    *d = (char)c;
+  }
+}
+
+/**
+ * @brief Compares up to 15 bytes eight at a time; the first differing byte
+ * is located from the lowest set bit of the XOR.
+ */
+
+static inline int cmp_small(const unsigned char *a, const unsigned char *b,
+                            size_t n) {
+  while (n >= 8) {
+    uint64_t x = *(const u64_u *)a ^ *(const u64_u *)b;
+    if (x != 0) {
+      size_t i = (size_t)__builtin_ctzll(x) >> 3;
+      return (int)(a[i] - b[i]);
+    }
+    a += 8;
+    b += 8;
+    n -= 8;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (a[i] != b[i]) {
+      return (int)(a[i] - b[i]);
+    }
+  }
+  return 0;
+}
+
+static inline void rep_movsb(void *d, const void *s, size_t n) {
+  __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+static inline void rep_stosb(void *d, unsigned char c, size_t n) {
+  __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+}
+
+/*
+ * ======
+ * =SSE2=
+ * ======
+ */
+
+static void *memcpy_sse2(void *dest, const void *src, size_t n) {
+  char *d = (char *)dest;
+  const char *s = (const char *)src;
+  if (n < 16) {
+    copy_small(d, s, n);
+    return dest;
+  }
+  __m128i head = _mm_loadu_si128((const __m128i *)s);
+  __m128i tail = _mm_loadu_si128((const __m128i *)(s + n - 16));
+  if (n <= 32) {
+    _mm_storeu_si128((__m128i *)d, head);
+    _mm_storeu_si128((__m128i *)(d + n - 16), tail);
+    return dest;
+  }
+
+  // Align the destination; the unaligned head store covers the skipped bytes
+  // and the tail store covers whatever the loop leaves.
+  size_t skew = 16 - ((uintptr_t)d & 15);
+  char *dp = d + skew;
+  const char *sp = s + skew;
+  size_t left = n - skew;
+  while (left > 64) {
+    __m128i a = _mm_loadu_si128((const __m128i *)sp);
+    __m128i b = _mm_loadu_si128((const __m128i *)(sp + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(sp + 32));
+    __m128i e = _mm_loadu_si128((const __m128i *)(sp + 48));
+    _mm_store_si128((__m128i *)dp, a);
+    _mm_store_si128((__m128i *)(dp + 16), b);
+    _mm_store_si128((__m128i *)(dp + 32), c);
+    _mm_store_si128((__m128i *)(dp + 48), e);
+    dp += 64;
+    sp += 64;
+    left -= 64;
+  }
+  while (left > 16) {
+    _mm_store_si128((__m128i *)dp, _mm_loadu_si128((const __m128i *)sp));
+    dp += 16;
+    sp += 16;
+    left -= 16;
+  }
+  _mm_storeu_si128((__m128i *)d, head);
+  _mm_storeu_si128((__m128i *)(d + n - 16), tail);
+  return dest;
+}
+
+static void *memset_sse2(void *s, int c, size_t n) {
+  char *d = (char *)s;
+  if (n < 16) {
+    set_small(d, (unsigned char)c, n);
+    return s;
+  }
+  __m128i v = _mm_set1_epi8((char)c);
+  _mm_storeu_si128((__m128i *)d, v);
+  _mm_storeu_si128((__m128i *)(d + n - 16), v);
+  if (n <= 32) {
+    return s;
+  }
+  char *dp = (char *)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+  char *end = d + n - 16;
+  while (dp + 64 <= end) {
+    _mm_store_si128((__m128i *)dp, v);
+    _mm_store_si128((__m128i *)(dp + 16), v);
+    _mm_store_si128((__m128i *)(dp + 32), v);
+    _mm_store_si128((__m128i *)(dp + 48), v);
+    dp += 64;
+  }
+  while (dp < end) {
+    _mm_store_si128((__m128i *)dp, v);
+    dp += 16;
+  }
+  return s;
+}
+
+static int memcmp_sse2(const void *s1, const void *s2, size_t n) {
+  const unsigned char *a = (const unsigned char *)s1;
+  const unsigned char *b = (const unsigned char *)s2;
+  if (n < 16) {
+    return cmp_small(a, b, n);
+  }
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+    if (m != 0) {
+      i += __builtin_ctz(m);
+      return (int)(a[i] - b[i]);
+    }
+  }
+  if (i < n) {
+    // Overlapping last block; the bytes it re-reads are already known equal.
+    i = n - 16;
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+    if (m != 0) {
+      i += __builtin_ctz(m);
+      return (int)(a[i] - b[i]);
+    }
+  }
+  return 0;
+}
+
+/*
+ * ======
+ * =AVX2=
+ * ======
+ */
+
+__attribute__((target("avx2"))) static void *
+memcpy_avx2(void *dest, const void *src, size_t n) {
+  char *d = (char *)dest;
+  const char *s = (const char *)src;
+  if (n <= 32) {
+    return memcpy_sse2(dest, src, n);
+  }
+  __m256i head = _mm256_loadu_si256((const __m256i *)s);
+  __m256i tail = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+  if (n <= 64) {
+    _mm256_storeu_si256((__m256i *)d, head);
+    _mm256_storeu_si256((__m256i *)(d + n - 32), tail);
+    return dest;
+  }
+
+  size_t skew = 32 - ((uintptr_t)d & 31);
+  char *dp = d + skew;
+  const char *sp = s + skew;
+  size_t left = n - skew;
+  while (left > 128) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)sp);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(sp + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i *)(sp + 64));
+    __m256i e = _mm256_loadu_si256((const __m256i *)(sp + 96));
+    _mm256_store_si256((__m256i *)dp, a);
+    _mm256_store_si256((__m256i *)(dp + 32), b);
+    _mm256_store_si256((__m256i *)(dp + 64), c);
+    _mm256_store_si256((__m256i *)(dp + 96), e);
+    dp += 128;
+    sp += 128;
+    left -= 128;
+  }
+  while (left > 32) {
+    _mm256_store_si256((__m256i *)dp, _mm256_loadu_si256((const __m256i *)sp));
+    dp += 32;
+    sp += 32;
+    left -= 32;
+  }
+  _mm256_storeu_si256((__m256i *)d, head);
+  _mm256_storeu_si256((__m256i *)(d + n - 32), tail);
+  return dest;
+}
+
+__attribute__((target("avx2"))) static void *memset_avx2(void *s, int c,
+                                                         size_t n) {
+  char *d = (char *)s;
+  if (n <= 32) {
+    return memset_sse2(s, c, n);
+  }
+  __m256i v = _mm256_set1_epi8((char)c);
+  _mm256_storeu_si256((__m256i *)d, v);
+  _mm256_storeu_si256((__m256i *)(d + n - 32), v);
+  if (n <= 64) {
+    return s;
+  }
+  char *dp = (char *)(((uintptr_t)d + 32) & ~(uintptr_t)31);
+  char *end = d + n - 32;
+  while (dp + 128 <= end) {
+    _mm256_store_si256((__m256i *)dp, v);
+    _mm256_store_si256((__m256i *)(dp + 32), v);
+    _mm256_store_si256((__m256i *)(dp + 64), v);
+    _mm256_store_si256((__m256i *)(dp + 96), v);
+    dp += 128;
+  }
+  while (dp < end) {
+    _mm256_store_si256((__m256i *)dp, v);
+    dp += 32;
+  }
+  return s;
+}
+
+__attribute__((target("avx2"))) static int
+memcmp_avx2(const void *s1, const void *s2, size_t n) {
+  const unsigned char *a = (const unsigned char *)s1;
+  const unsigned char *b = (const unsigned char *)s2;
+  if (n < 32) {
+    return memcmp_sse2(s1, s2, n);
+  }
+  size_t i = 0;
+  for (;; i += 32) {
+    if (i + 32 > n) {
+      i = n - 32;
+    }
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    unsigned m = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+    if (m != 0) {
+      i += __builtin_ctz(m);
+      return (int)(a[i] - b[i]);
+    }
+    if (i + 32 == n) {
+      return 0;
+    }
+  }
+}
+
+/*
+ * =========
+ * =AVX-512=
+ * =========
+ */
+
+static inline uint64_t byte_mask(size_t n) {
+  return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void *
+memcpy_avx512(void *dest, const void *src, size_t n) {
+  char *d = (char *)dest;
+  const char *s = (const char *)src;
+  if (n <= 64) {
+    // Masked accesses never touch (or fault on) bytes outside [0, n).
+    __mmask64 k = byte_mask(n);
+    _mm512_mask_storeu_epi8(d, k, _mm512_maskz_loadu_epi8(k, s));
+    return dest;
+  }
+  __m512i head = _mm512_loadu_si512(s);
+  __m512i tail = _mm512_loadu_si512(s + n - 64);
+  if (n <= 128) {
+    _mm512_storeu_si512(d, head);
+    _mm512_storeu_si512(d + n - 64, tail);
+    return dest;
+  }
+
+  size_t skew = 64 - ((uintptr_t)d & 63);
+  char *dp = d + skew;
+  const char *sp = s + skew;
+  size_t left = n - skew;
+  while (left > 256) {
+    __m512i a = _mm512_loadu_si512(sp);
+    __m512i b = _mm512_loadu_si512(sp + 64);
+    __m512i c = _mm512_loadu_si512(sp + 128);
+    __m512i e = _mm512_loadu_si512(sp + 192);
+    _mm512_store_si512(dp, a);
+    _mm512_store_si512(dp + 64, b);
+    _mm512_store_si512(dp + 128, c);
+    _mm512_store_si512(dp + 192, e);
+    dp += 256;
+    sp += 256;
+    left -= 256;
+  }
+  while (left > 64) {
+    _mm512_store_si512(dp, _mm512_loadu_si512(sp));
+    dp += 64;
+    sp += 64;
+    left -= 64;
+  }
+  _mm512_storeu_si512(d, head);
+  _mm512_storeu_si512(d + n - 64, tail);
+  return dest;
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void *
+memset_avx512(void *s, int c, size_t n) {
+  char *d = (char *)s;
+  __m512i v = _mm512_set1_epi8((char)c);
+  if (n <= 64) {
+    _mm512_mask_storeu_epi8(d, byte_mask(n), v);
+    return s;
+  }
+  _mm512_storeu_si512(d, v);
+  _mm512_storeu_si512(d + n - 64, v);
+  if (n <= 128) {
+    return s;
+  }
+  char *dp = (char *)(((uintptr_t)d + 64) & ~(uintptr_t)63);
+  char *end = d + n - 64;
+  while (dp + 256 <= end) {
+    _mm512_store_si512(dp, v);
+    _mm512_store_si512(dp + 64, v);
+    _mm512_store_si512(dp + 128, v);
+    _mm512_store_si512(dp + 192, v);
+    dp += 256;
+  }
+  while (dp < end) {
+    _mm512_store_si512(dp, v);
+    dp += 64;
+  }
+  return s;
+}
+
+__attribute__((target("avx512f,avx512bw"))) static int
+memcmp_avx512(const void *s1, const void *s2, size_t n) {
+  const unsigned char *a = (const unsigned char *)s1;
+  const unsigned char *b = (const unsigned char *)s2;
+  size_t i = 0;
+  for (; i < n; i += 64) {
+    __mmask64 k = byte_mask(n - i);
+    __m512i x = _mm512_maskz_loadu_epi8(k, a + i);
+    __m512i y = _mm512_maskz_loadu_epi8(k, b + i);
+    uint64_t m = _mm512_cmpneq_epi8_mask(x, y);
+    if (m != 0) {
+      i += __builtin_ctzll(m);
+      return (int)(a[i] - b[i]);
+    }
+  }
+  return 0;
+}
+
+/*
+ * ==========
+ * =Dispatch=
+ * ==========
+ */
+
+/**
+ * @brief Binds the best kernels for the running CPU. Runs once, on the first
+ * call to any of the three primitives.
+ */
+
+static void resolve_all(void) {
+  unsigned f = gui_cpu_features();
+
+  if (f & GUI_CPU_AVX512) {
+    _memcpy_impl = memcpy_avx512;
+    _memset_impl = memset_avx512;
+    _memcmp_impl = memcmp_avx512;
+  } else if (f & GUI_CPU_AVX2) {
+    _memcpy_impl = memcpy_avx2;
+    _memset_impl = memset_avx2;
+    _memcmp_impl = memcmp_avx2;
+  } else {
+    _memcpy_impl = memcpy_sse2;
+    _memset_impl = memset_sse2;
+    _memcmp_impl = memcmp_sse2;
+  }
+
+  if (f & GUI_CPU_FSRM) {
+    _rep_threshold = REP_THRESHOLD_FSRM;
+  } else if (f & GUI_CPU_ERMS) {
+    _rep_threshold = REP_THRESHOLD;
+  }
+}
+
+static void *memcpy_resolve(void *dest, const void *src, size_t n) {
+  resolve_all();
+  return guimemcpy(dest, src, n);
+}
+
+static void *memset_resolve(void *s, int c, size_t n) {
+  resolve_all();
+  return guimemset(s, c, n);
+}
+
+static int memcmp_resolve(const void *s1, const void *s2, size_t n) {
+  resolve_all();
+  return guimemcmp(s1, s2, n);
+}
+
+/**
+ * @brief Copies 'n' bytes from the memory area 'src' to 'dest'.
+ *
+ * Functionally equivalent to 'memcpy'.
+ * Assumes that the areas do not overlap (default behavior of memcpy).
+ */
+
+void *guimemcpy(void *dest, const void *src, size_t n) {
+  if (n >= _rep_threshold) {
+    rep_movsb(dest, src, n);
+    return dest;
+  }
+  return _memcpy_impl(dest, src, n);
+}
+
+/**
+ * @brief Fills the first 'n' bytes of the memory area pointed to by 's'
+ *
+ * with the constant byte 'c'.
+ * Functionally equivalent to 'memset'.
+ */
+
+void *guimemset(void *s, int c, size_t n) {
+  if (n >= _rep_threshold) {
+    rep_stosb(s, (unsigned char)c, n);
+    return s;
+  }
+  return _memset_impl(s, c, n);
+}
+
+/**
+ * @brief Compares the first 'n' bytes of memory areas 's1' and 's2'.
+ *
+ * Functionally equivalent to 'memcmp'.
+ */
+
+int guimemcmp(const void *s1, const void *s2, size_t n) {
+  return _memcmp_impl(s1, s2, n);
+}
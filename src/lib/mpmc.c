@@ -0,0 +1,112 @@
+/*
+ * @file mpmc.c
+ * @brief Bounded MPMC queue (see mpmc.h).
+ *
+ * Cell i starts with sequence i. A producer at position pos may fill the
+ * cell when its sequence equals pos and publishes it with pos + 1; a
+ * consumer at pos may empty it when the sequence is pos + 1 and hands it
+ * back to the producers of the next lap with pos + capacity. A sequence
+ * behind the position means the queue is full (push) or empty (pop).
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/mman.h>
+#include <stdint.h>
+#include "atomic.h"
+#include "mpmc.h"
+#include "sys/guicall.h"
+#include "sys/sysnums.h"
+
+/**
+ * @brief Sets up a queue for at least 'capacity' items.
+ * @return 0, or -ENOMEM.
+ */
+
+int gui_mpmc_init(gui_mpmc *queue, size_t capacity) {
+  size_t slots = 2;
+  while (slots < capacity) {
+    slots *= 2;
+  }
+  size_t size = slots * sizeof(gui_mpmc_cell);
+  int64_t mem = guicall(SYS_mmap, NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (mem < 0) {
+    queue->cells = NULL;
+    return -ENOMEM;
+  }
+  queue->cells = (gui_mpmc_cell *)mem;
+  queue->map_size = size;
+  queue->mask = slots - 1;
+  queue->head = 0;
+  queue->tail = 0;
+  for (size_t i = 0; i < slots; ++i) {
+    queue->cells[i].seq = i;
+  }
+  return 0;
+}
+
+void gui_mpmc_destroy(gui_mpmc *queue) {
+  if (queue->cells != NULL) {
+    guicall(SYS_munmap, queue->cells, queue->map_size);
+    queue->cells = NULL;
+  }
+}
+
+/**
+ * @brief Appends 'item'.
+ * @return 0, or -EAGAIN when the queue is full.
+ */
+
+int gui_mpmc_push(gui_mpmc *queue, void *item) {
+  size_t pos = gui_atomic_load(&queue->head);
+  gui_mpmc_cell *cell;
+  for (;;) {
+    cell = &queue->cells[pos & queue->mask];
+    size_t seq = gui_atomic_load_acquire(&cell->seq);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      // On failure the CAS reloads 'pos' with the current head.
+      if (gui_atomic_cas_weak(&queue->head, &pos, pos + 1)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return -EAGAIN;
+    } else {
+      pos = gui_atomic_load(&queue->head);
+    }
+  }
+  cell->item = item;
+  gui_atomic_store_release(&cell->seq, pos + 1);
+  return 0;
+}
+
+/**
+ * @brief Removes the oldest item.
+ * @return The item, or NULL when the queue is empty.
+ */
+
+void *gui_mpmc_pop(gui_mpmc *queue) {
+  size_t pos = gui_atomic_load(&queue->tail);
+  gui_mpmc_cell *cell;
+  for (;;) {
+    cell = &queue->cells[pos & queue->mask];
+    size_t seq = gui_atomic_load_acquire(&cell->seq);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (gui_atomic_cas_weak(&queue->tail, &pos, pos + 1)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return NULL;
+    } else {
+      pos = gui_atomic_load(&queue->tail);
+    }
+  }
+  void *item = cell->item;
+  gui_atomic_store_release(&cell->seq, pos + queue->mask + 1);
+  return item;
+}
@@ -0,0 +1,34 @@
+#ifndef MPMC_H
+#define MPMC_H
+
+#include <stddef.h>
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue of pointers
+ * (Dmitry Vyukov's array queue). Every cell carries a sequence number that
+ * tells producers and consumers whose turn it is, so a push or a pop is
+ * one CAS on the shared position plus one release store on the cell.
+ *
+ * The capacity is fixed at init (rounded up to a power of two): push fails
+ * instead of growing when the queue is full. Any thread may push or pop.
+ */
+
+typedef struct gui_mpmc_cell {
+  size_t seq;
+  void *item;
+} gui_mpmc_cell;
+
+typedef struct gui_mpmc {
+  size_t head __attribute__((aligned(64))); // Next position to push.
+  size_t tail __attribute__((aligned(64))); // Next position to pop.
+  size_t mask;
+  gui_mpmc_cell *cells;
+  size_t map_size;
+} gui_mpmc;
+
+int gui_mpmc_init(gui_mpmc *queue, size_t capacity);
+void gui_mpmc_destroy(gui_mpmc *queue);
+int gui_mpmc_push(gui_mpmc *queue, void *item);
+void *gui_mpmc_pop(gui_mpmc *queue);
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * @file opt.c
+ * @brief getopt_long() work-alike on caller-owned state (see opt.h).
+ *
+ * Operands are permuted the way glibc does it: they are skipped and
+ * remembered as the block argv[first .. last - 1]; once the options that
+ * followed them have been consumed, the two blocks are swapped, so at the
+ * end every option precedes every operand and 'ind' points at the first
+ * operand.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include "lib.h"
+#include "opt.h"
+#include "out.h"
+
+static int is_option(const char *arg) { return arg[0] == '-' && arg[1] != '\0'; }
+
+static void reverse(char **argv, int from, int to) {
+  while (from < --to) {
+    char *tmp = argv[from];
+    argv[from++] = argv[to];
+    argv[to] = tmp;
+  }
+}
+
+/**
+ * @brief Moves the options parsed since the last skipped operands,
+ * argv[last .. ind - 1], in front of those operands.
+ */
+
+static void exchange(gui_opt_state *st, char **argv) {
+  reverse(argv, st->first, st->last);
+  reverse(argv, st->last, st->ind);
+  reverse(argv, st->first, st->ind);
+  st->first += st->ind - st->last;
+  st->last = st->ind;
+}
+
+static void report(const char *prog, const char *what, const char *opt,
+                   size_t len, const char *tail) {
+  gui_out *err = gui_stderr;
+  gui_out_str(err, prog);
+  gui_out_str(err, what);
+  gui_out_write(err, opt, len);
+  gui_out_str(err, tail);
+}
+
+/**
+ * @brief Parses the long option at argv[ind] (past its "--").
+ */
+
+static int long_option(gui_opt_state *st, int argc, char **argv,
+                       const gui_option *longopts) {
+  char *name = argv[st->ind++] + 2;
+  size_t len = 0;
+  while (name[len] != '\0' && name[len] != '=') {
+    len++;
+  }
+
+  const gui_option *found = NULL;
+  int ambiguous = 0;
+  for (const gui_option *o = longopts; o != NULL && o->name != NULL; ++o) {
+    if (guincmp(o->name, name, len) != 0) {
+      continue;
+    }
+    if (o->name[len] == '\0') {
+      found = o;
+      ambiguous = 0;
+      break;
+    }
+    if (found == NULL) {
+      found = o;
+    } else if (found->has_arg != o->has_arg || found->val != o->val) {
+      ambiguous = 1;
+    }
+  }
+
+  const char *prog = argv[0];
+  if (ambiguous) {
+    report(prog, ": option '--", name, guilen(name),
+           "' is ambiguous; possibilities:");
+    for (const gui_option *o = longopts; o->name != NULL; ++o) {
+      if (guincmp(o->name, name, len) == 0) {
+        gui_out_str(gui_stderr, " '--");
+        gui_out_str(gui_stderr, o->name);
+        gui_out_char(gui_stderr, '\'');
+      }
+    }
+    gui_out_char(gui_stderr, '\n');
+    st->opt = 0;
+    return '?';
+  }
+  if (found == NULL) {
+    report(prog, ": unrecognized option '--", name, guilen(name), "'\n");
+    st->opt = 0;
+    return '?';
+  }
+
+  if (name[len] == '=') {
+    if (found->has_arg == GUI_NO_ARG) {
+      report(prog, ": option '--", found->name, guilen(found->name),
+             "' doesn't allow an argument\n");
+      st->opt = found->val;
+      return '?';
+    }
+    st->arg = name + len + 1;
+  } else if (found->has_arg == GUI_REQUIRED_ARG) {
+    if (st->ind == argc) {
+      report(prog, ": option '--", found->name, guilen(found->name),
+             "' requires an argument\n");
+      st->opt = found->val;
+      return '?';
+    }
+    st->arg = argv[st->ind++];
+  }
+  return found->val;
+}
+
+/**
+ * @brief Parses the next character of the short option cluster.
+ */
+
+static int short_option(gui_opt_state *st, int argc, char **argv,
+                        const char *shortopts) {
+  char c = *st->next++;
+  const char *spec = shortopts;
+  while (*spec != '\0' && *spec != c) {
+    spec++;
+  }
+  if (*st->next == '\0') {
+    st->ind++;
+  }
+
+  if (*spec == '\0' || c == ':') {
+    report(argv[0], ": invalid option -- '", &c, 1, "'\n");
+    st->opt = c;
+    return '?';
+  }
+  if (spec[1] != ':') {
+    return c;
+  }
+
+  if (*st->next != '\0') {
+    // "-w80": the rest of the cluster is the argument.
+    st->arg = st->next;
+    st->ind++;
+  } else if (spec[2] == ':') {
+    // Optional arguments must be attached.
+  } else if (st->ind == argc) {
+    report(argv[0], ": option requires an argument -- '", &c, 1, "'\n");
+    st->opt = c;
+    st->next = NULL;
+    return '?';
+  } else {
+    st->arg = argv[st->ind++];
+  }
+  st->next = NULL;
+  return c;
+}
+
+/**
+ * @brief Returns the next option of argv: its character or long option
+ * value, '?' for an invalid one, or -1 once only operands are left (the
+ * first of them is then argv[st->ind]).
+ */
+
+int gui_getopt_long(gui_opt_state *st, int argc, char **argv,
+                    const char *shortopts, const gui_option *longopts) {
+  st->arg = NULL;
+  if (st->next == NULL || *st->next == '\0') {
+    if (st->first != st->last && st->last != st->ind) {
+      exchange(st, argv);
+    } else if (st->last != st->ind) {
+      st->first = st->ind;
+    }
+    while (st->ind < argc && !is_option(argv[st->ind])) {
+      st->ind++;
+    }
+    st->last = st->ind;
+
+    if (st->ind < argc && guicmp(argv[st->ind], "--") == 0) {
+      // Everything after "--" is an operand.
+      st->ind++;
+      if (st->first != st->last && st->last != st->ind) {
+        exchange(st, argv);
+      } else if (st->first == st->last) {
+        st->first = st->ind;
+      }
+      st->last = argc;
+      st->ind = argc;
+    }
+    if (st->ind == argc) {
+      if (st->first != st->last) {
+        st->ind = st->first;
+      }
+      return -1;
+    }
+
+    if (argv[st->ind][1] == '-') {
+      st->next = NULL;
+      return long_option(st, argc, argv, longopts);
+    }
+    st->next = argv[st->ind] + 1;
+  }
+  return short_option(st, argc, argv, shortopts);
+}
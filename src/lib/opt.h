@@ -0,0 +1,44 @@
+#ifndef OPT_H
+#define OPT_H
+
+/*
+ * Command-line option parser with the behaviour of glibc's getopt_long():
+ * short option clusters ("-la", "-w80", "-w 80"), long options ("--width=80",
+ * "--width 80", unambiguous prefixes such as "--wid"), "--" to end the
+ * options, and operands permuted behind the options so they may appear
+ * anywhere. Errors are reported on stderr in glibc's words and returned as
+ * '?'.
+ *
+ *   gui_opt_state st = GUI_OPT_STATE_INIT;
+ *   while ((c = gui_getopt_long(&st, argc, argv, "lw:", longs)) != -1) {
+ *     ... st.arg holds the argument of an option that takes one ...
+ *   }
+ *   // argv[st.ind .. argc - 1] are the operands.
+ *
+ * The state lives in the caller instead of in globals, so nothing here
+ * depends on libc.
+ */
+
+enum { GUI_NO_ARG, GUI_REQUIRED_ARG, GUI_OPTIONAL_ARG };
+
+typedef struct gui_option {
+  const char *name; // Without the leading "--".
+  int has_arg;      // GUI_NO_ARG, GUI_REQUIRED_ARG or GUI_OPTIONAL_ARG.
+  int val;          // Returned when the option is found.
+} gui_option;
+
+typedef struct gui_opt_state {
+  int ind;    // Next element of argv to look at; the first operand at the end.
+  char *arg;  // Argument of the option just returned, or NULL.
+  int opt;    // The offending option character after a '?'.
+  char *next; // Rest of the short option cluster being parsed.
+  int first;  // Operands skipped so far: argv[first .. last - 1].
+  int last;
+} gui_opt_state;
+
+#define GUI_OPT_STATE_INIT {1, 0, 0, 0, 1, 1}
+
+int gui_getopt_long(gui_opt_state *st, int argc, char **argv,
+                    const char *shortopts, const gui_option *longopts);
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * @file out.c
+ * @brief Buffered output engine for the mini-coreutils tools.
+ *
+ * Every fragment a tool prints goes into a per-stream buffer instead of its
+ * own write syscall. Buffers are drained when they fill up, on newlines for
+ * terminals, on an explicit gui_out_flush() and on gui_exit(). When an append
+ * does not fit, the pending buffer and the new data leave together in a
+ * single writev.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/mman.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "fmt.h"
+#include "lib.h"
+#include "out.h"
+#include "sys/guicall.h"
+#include "sys/sysnums.h"
+
+#define OUT_STDOUT_SIZE (1024 * 64)
+#define OUT_STDERR_SIZE (1024 * 4)
+
+#define OUT_MEM_INITIAL (1024 * 4)
+
+#define TCGETS 0x5401
+
+struct iovec64 {
+  const void *iov_base;
+  size_t iov_len;
+};
+
+static char _stdout_buf[OUT_STDOUT_SIZE];
+static char _stderr_buf[OUT_STDERR_SIZE];
+
+static gui_out _stdout = {STDOUT_FILENO, GUI_OUT_AUTO, 0, 0, OUT_STDOUT_SIZE,
+                          _stdout_buf, NULL, 0};
+static gui_out _stderr = {STDERR_FILENO, GUI_OUT_LINE, 0, 0, OUT_STDERR_SIZE,
+                          _stderr_buf, NULL, 0};
+
+gui_out *const gui_stdout = &_stdout;
+gui_out *const gui_stderr = &_stderr;
+
+/**
+ * @brief Resolves GUI_OUT_AUTO: a terminal gets line buffering, everything
+ * else (pipes, files, sockets) gets full buffering.
+ */
+
+static void resolve_mode(gui_out *out) {
+  char termios[64];
+  if (guicall(SYS_ioctl, out->fd, TCGETS, termios) == 0) {
+    out->mode = GUI_OUT_LINE;
+  } else {
+    out->mode = GUI_OUT_FULL;
+  }
+}
+
+/**
+ * @brief Writes out the iovec array completely, retrying on short writes and
+ * EINTR.
+ */
+
+static int write_all(gui_out *out, struct iovec64 *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    int64_t n = guicall(SYS_writev, out->fd, iov, iovcnt);
+    if (n < 0) {
+      if (n == -EINTR) {
+        continue;
+      }
+      out->err = (int)n;
+      return (int)n;
+    }
+    while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (const char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Drains the buffered bytes of 'out'.
+ * @return 0 on success, or the (sticky) negative errno of the failed write.
+ */
+
+int gui_out_flush(gui_out *out) {
+  if (out->fd < 0) {
+    return out->err;
+  }
+  if (out->len > 0 && out->err == 0) {
+    struct iovec64 iov = {out->buf, out->len};
+    write_all(out, &iov, 1);
+  }
+  out->len = 0;
+  return out->err;
+}
+
+/**
+ * @brief Forces a buffering mode, e.g. to turn line buffering off for a
+ * terminal when a tool knows it is producing bulk output.
+ */
+
+void gui_out_setmode(gui_out *out, int mode) {
+  gui_out_flush(out);
+  out->mode = mode;
+}
+
+/**
+ * @brief Starts an empty memory stream. No memory is mapped until the first
+ * append.
+ */
+
+void gui_out_mem_init(gui_out *out) { gui_out_mem_init_buf(out, NULL, 0); }
+
+/**
+ * @brief Starts an empty memory stream on the caller's 'cap' bytes at 'buf'.
+ * Output that outgrows them moves to a mapping; gui_out_mem_free() unmaps
+ * that and returns to 'buf', which is never unmapped.
+ */
+
+void gui_out_mem_init_buf(gui_out *out, char *buf, size_t cap) {
+  out->fd = -1;
+  out->mode = GUI_OUT_FULL;
+  out->err = 0;
+  out->len = 0;
+  out->cap = cap;
+  out->buf = buf;
+  out->first = buf;
+  out->first_cap = cap;
+}
+
+void gui_out_mem_free(gui_out *out) {
+  if (out->buf != out->first) {
+    guicall(SYS_munmap, out->buf, out->cap);
+  }
+  gui_out_mem_init_buf(out, out->first, out->first_cap);
+}
+
+/**
+ * @brief Grows a memory stream so 'n' more bytes fit.
+ */
+
+static int mem_grow(gui_out *out, size_t n) {
+  size_t cap = out->cap ? out->cap : OUT_MEM_INITIAL;
+  while (cap < out->len + n) {
+    cap *= 2;
+  }
+  int64_t buf;
+  if (out->buf == out->first) {
+    buf = guicall(SYS_mmap, NULL, cap, PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (buf >= 0 && out->len > 0) {
+      guimemcpy((char *)buf, out->buf, out->len);
+    }
+  } else {
+    buf = guicall(SYS_mremap, out->buf, out->cap, cap, MREMAP_MAYMOVE);
+  }
+  if (buf < 0) {
+    out->err = -ENOMEM;
+    return -ENOMEM;
+  }
+  out->buf = (char *)buf;
+  out->cap = cap;
+  return 0;
+}
+
+/**
+ * @brief Out-of-line half of gui_out_write(): handles mode resolution,
+ * buffer overflow and line buffering.
+ */
+
+void gui_out_write_slow(gui_out *out, const void *data, size_t n) {
+  if (out->mode == GUI_OUT_AUTO) {
+    resolve_mode(out);
+  }
+  if (out->err != 0) {
+    return;
+  }
+
+  if (out->fd < 0) {
+    if (n > out->cap - out->len && mem_grow(out, n) < 0) {
+      return;
+    }
+    guimemcpy(out->buf + out->len, data, n);
+    out->len += n;
+    return;
+  }
+
+  if (n > out->cap - out->len) {
+    // Buffer and payload go out together; no copy of the payload needed.
+    struct iovec64 iov[2] = {{out->buf, out->len}, {data, n}};
+    write_all(out, out->len > 0 ? iov : iov + 1, out->len > 0 ? 2 : 1);
+    out->len = 0;
+    return;
+  }
+
+  guimemcpy(out->buf + out->len, data, n);
+  out->len += n;
+
+  if (out->mode == GUI_OUT_LINE) {
+    const char *p = (const char *)data;
+    for (size_t i = 0; i < n; ++i) {
+      if (p[i] == '\n') {
+        gui_out_flush(out);
+        break;
+      }
+    }
+  }
+}
+
+void gui_out_str(gui_out *out, const char *str) {
+  gui_out_write(out, str, guilen(str));
+}
+
+void gui_out_unum(gui_out *out, uint64_t num) {
+  char buf[GUI_FMT_MAX];
+  gui_out_write(out, buf, gui_fmt_u64(buf, num));
+}
+
+void gui_out_num(gui_out *out, int64_t num) {
+  char buf[GUI_FMT_MAX];
+  gui_out_write(out, buf, gui_fmt_i64(buf, num));
+}
+
+/*
+ * ================
+ * =Escaped output=
+ * ================
+ *
+ * One class byte per input byte: 0 copies it, ESC_HEX writes it as \u00XX,
+ * ESC_UTF8 starts a multi-byte sequence, and anything else is the letter
+ * written after a backslash. Runs of plain bytes are found with one table
+ * lookup per byte and appended with a single gui_out_write().
+ */
+
+#define ESC_HEX 1
+#define ESC_UTF8 2
+
+static const unsigned char json_class[256] = {
+    [0 ... 0x07] = ESC_HEX, ['\b'] = 'b',  ['\t'] = 't',
+    ['\n'] = 'n',           [0x0b] = ESC_HEX, ['\f'] = 'f',
+    ['\r'] = 'r',           [0x0e ... 0x1f] = ESC_HEX,
+    ['"'] = '"',            ['\\'] = '\\',  [0x7f] = ESC_HEX,
+    [0x80 ... 0xff] = ESC_UTF8};
+
+// The escapes of PostgreSQL's text COPY format and most TSV readers.
+static const unsigned char tsv_class[256] = {
+    ['\t'] = 't', ['\n'] = 'n', ['\r'] = 'r', ['\\'] = '\\'};
+
+/**
+ * @brief Length of the well-formed UTF-8 sequence at 'p', or 0 when it is
+ * truncated, overlong, a surrogate or beyond U+10FFFF.
+ */
+
+static size_t utf8_seq(const unsigned char *p, const unsigned char *end) {
+  size_t n;
+  uint32_t min;
+  if (*p >= 0xc2 && *p <= 0xdf) {
+    n = 2, min = 0x80;
+  } else if (*p >= 0xe0 && *p <= 0xef) {
+    n = 3, min = 0x800;
+  } else if (*p >= 0xf0 && *p <= 0xf4) {
+    n = 4, min = 0x10000;
+  } else {
+    return 0;
+  }
+  if ((size_t)(end - p) < n) {
+    return 0;
+  }
+  uint32_t c = *p & (0x7f >> n);
+  for (size_t i = 1; i < n; ++i) {
+    if ((p[i] & 0xc0) != 0x80) {
+      return 0;
+    }
+    c = (c << 6) | (p[i] & 0x3f);
+  }
+  if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+    return 0;
+  }
+  return n;
+}
+
+static void out_escaped(gui_out *out, const char *str, size_t len,
+                        const unsigned char *classes) {
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *p = (const unsigned char *)str;
+  const unsigned char *end = p + len;
+
+  while (p < end) {
+    const unsigned char *run = p;
+    while (p < end && classes[*p] == 0) {
+      ++p;
+    }
+    gui_out_write(out, run, (size_t)(p - run));
+    if (p == end) {
+      break;
+    }
+
+    unsigned char c = classes[*p];
+    if (c == ESC_UTF8) {
+      size_t n = utf8_seq(p, end);
+      if (n > 0) {
+        gui_out_write(out, p, n);
+        p += n;
+        continue;
+      }
+      // Not UTF-8: the byte becomes a lone low surrogate U+DC80..U+DCFF,
+      // the mapping Python's "surrogateescape" decodes back to the byte.
+      char esc[6] = {'\\', 'u', 'd', 'c', hex[*p >> 4], hex[*p & 0xf]};
+      gui_out_write(out, esc, sizeof(esc));
+    } else if (c == ESC_HEX) {
+      char esc[6] = {'\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 0xf]};
+      gui_out_write(out, esc, sizeof(esc));
+    } else {
+      char esc[2] = {'\\', (char)c};
+      gui_out_write(out, esc, sizeof(esc));
+    }
+    ++p;
+  }
+}
+
+/**
+ * @brief Appends 'len' bytes of 'str' as the inside of a JSON string.
+ * Control characters and DEL are escaped; bytes that are not UTF-8 are
+ * written as \udcXX.
+ */
+
+void gui_out_json(gui_out *out, const char *str, size_t len) {
+  out_escaped(out, str, len, json_class);
+}
+
+/**
+ * @brief Appends 'len' bytes of 'str' as one TSV field: tab, newline,
+ * carriage return and backslash become \t, \n, \r and \\.
+ */
+
+void gui_out_tsv(gui_out *out, const char *str, size_t len) {
+  out_escaped(out, str, len, tsv_class);
+}
+
+/**
+ * @brief Flushes the standard streams and terminates the process.
+ * Tools call this instead of a bare SYS_exit so no buffered output is lost.
+ */
+
+void gui_exit(int code) {
+  gui_out_flush(gui_stdout);
+#ifdef GUI_SYSSTATS
+  gui_sysstats_report();
+#endif
+  gui_out_flush(gui_stderr);
+  for (;;) {
+    guicall(SYS_exit_group, code);
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef OUT_H
+#define OUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Buffered output streams. Tools append fragments to a stream and the
+ * engine turns them into as few write/writev syscalls as possible.
+ *
+ * A stream starts in GUI_OUT_AUTO mode and picks its real mode on the first
+ * append: line-buffered when the fd is a terminal, block-buffered otherwise.
+ *
+ * A memory stream (gui_out_mem_init, fd < 0) never writes anything; its
+ * buffer grows instead, so output can be produced now and emitted later.
+ * gui_out_mem_init_buf() starts one on a buffer the caller owns, e.g. one
+ * that is recycled with the object it belongs to; only output that outgrows
+ * it is mapped.
+ *
+ * gui_out_json() and gui_out_tsv() append a string escaped for a JSON string
+ * literal (without the quotes) or a TSV field, encoding straight into the
+ * stream buffer.
+ */
+
+#define GUI_OUT_AUTO 0
+#define GUI_OUT_FULL 1
+#define GUI_OUT_LINE 2
+
+typedef struct gui_out {
+  int fd;
+  int mode;
+  int err; // First write error (-errno), sticky. Later output is dropped.
+  size_t len;
+  size_t cap;
+  char *buf;
+  char *first;      // Memory streams: caller-owned buffer to start from.
+  size_t first_cap;
+} gui_out;
+
+extern gui_out *const gui_stdout;
+extern gui_out *const gui_stderr;
+
+void gui_out_write_slow(gui_out *out, const void *data, size_t n);
+void gui_out_str(gui_out *out, const char *str);
+void gui_out_num(gui_out *out, int64_t num);
+void gui_out_unum(gui_out *out, uint64_t num);
+void gui_out_json(gui_out *out, const char *str, size_t len);
+void gui_out_tsv(gui_out *out, const char *str, size_t len);
+int gui_out_flush(gui_out *out);
+void gui_out_setmode(gui_out *out, int mode);
+
+void gui_out_mem_init(gui_out *out);
+void gui_out_mem_init_buf(gui_out *out, char *buf, size_t cap);
+void gui_out_mem_free(gui_out *out);
+
+void gui_exit(int code) __attribute__((noreturn));
+
+/**
+ * @brief Appends 'n' bytes to 'out'. Block-buffered streams with room left
+ * never leave this inline fast path.
+ */
+
+static inline void gui_out_write(gui_out *out, const void *data, size_t n) {
+  if (out->mode == GUI_OUT_FULL && n <= out->cap - out->len) {
+    const char *s = (const char *)data;
+    char *d = out->buf + out->len;
+    out->len += n;
+    while (n--) {
+      *d++ = *s++;
+    }
+    return;
+  }
+  gui_out_write_slow(out, data, n);
+}
+
+static inline void gui_out_char(gui_out *out, char c) {
+  if (out->mode == GUI_OUT_FULL && out->len < out->cap) {
+    out->buf[out->len++] = c;
+    return;
+  }
+  gui_out_write_slow(out, &c, 1);
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * @file path.c
+ * @brief Length-tracking path builder backed by mmap/mremap.
+ *
+ * There is no PATH_MAX limit: the buffer starts at one page and doubles in
+ * place (or moves, via MREMAP_MAYMOVE) whenever a push would overflow it.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/mman.h>
+#include <stdint.h>
+#include "lib.h"
+#include "path.h"
+#include "sys/guicall.h"
+#include "sys/sysnums.h"
+
+#define PATH_INITIAL_CAP 4096
+
+/**
+ * @brief Makes room for at least 'need' bytes (NUL included).
+ * @return 0 on success, -ENOMEM when the mapping cannot grow.
+ */
+
+static int path_reserve(gui_path *path, size_t need) {
+  if (need <= path->cap) {
+    return 0;
+  }
+  size_t cap = path->cap;
+  while (cap < need) {
+    cap *= 2;
+  }
+  int64_t buf = guicall(SYS_mremap, path->buf, path->cap, cap, MREMAP_MAYMOVE);
+  if (buf < 0) {
+    return -ENOMEM;
+  }
+  path->buf = (char *)buf;
+  path->cap = cap;
+  return 0;
+}
+
+/**
+ * @brief Starts a path at 'base' (which may be longer than PATH_MAX).
+ * @return 0 on success, -ENOMEM when no memory could be mapped.
+ */
+
+int gui_path_init(gui_path *path, const char *base) {
+  size_t len = guilen(base);
+  int64_t buf = guicall(SYS_mmap, NULL, PATH_INITIAL_CAP,
+                        PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                        -1, 0);
+  if (buf < 0) {
+    return -ENOMEM;
+  }
+  path->buf = (char *)buf;
+  path->cap = PATH_INITIAL_CAP;
+  path->len = 0;
+  if (path_reserve(path, len + 1) < 0) {
+    gui_path_free(path);
+    return -ENOMEM;
+  }
+  guimemcpy(path->buf, base, len + 1);
+  path->len = len;
+  return 0;
+}
+
+/**
+ * @brief Appends "/name" (just "name" when the path already ends in '/' or is
+ * empty). Only the new component is copied.
+ * @return 0 on success, -ENOMEM when the buffer cannot grow.
+ */
+
+int gui_path_push(gui_path *path, const char *name, size_t len) {
+  int slash = path->len > 0 && path->buf[path->len - 1] != '/';
+  if (path_reserve(path, path->len + slash + len + 1) < 0) {
+    return -ENOMEM;
+  }
+  char *end = path->buf + path->len;
+  if (slash) {
+    *end++ = '/';
+  }
+  guimemcpy(end, name, len);
+  end[len] = '\0';
+  path->len += slash + len;
+  return 0;
+}
+
+void gui_path_free(gui_path *path) {
+  if (path->buf != NULL) {
+    guicall(SYS_munmap, path->buf, path->cap);
+  }
+  path->buf = NULL;
+  path->len = 0;
+  path->cap = 0;
+}
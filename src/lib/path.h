@@ -0,0 +1,36 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <stddef.h>
+
+/*
+ * Growable path builder. The buffer always holds a NUL-terminated path and
+ * knows its own length, so descending into a child appends only the child's
+ * name and going back up is a single store.
+ *
+ *   size_t mark = path.len;
+ *   gui_path_push(&path, name, name_len);  // "dir" -> "dir/name"
+ *   ...
+ *   gui_path_pop(&path, mark);             // back to "dir"
+ */
+
+typedef struct gui_path {
+  char *buf;
+  size_t len;
+  size_t cap;
+} gui_path;
+
+int gui_path_init(gui_path *path, const char *base);
+int gui_path_push(gui_path *path, const char *name, size_t len);
+void gui_path_free(gui_path *path);
+
+/**
+ * @brief Truncates 'path' back to a length saved before a push.
+ */
+
+static inline void gui_path_pop(gui_path *path, size_t mark) {
+  path->len = mark;
+  path->buf[mark] = '\0';
+}
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * @file sort.c
+ * @brief Key-prefixed introsort and multikey radix sort (see sort.h).
+ *
+ * Median-of-three quicksort that switches to heapsort when the recursion
+ * gets deeper than 2*log2(n), so the worst case stays O(n log n), and to
+ * insertion sort for short ranges. The larger half is handled by the loop
+ * instead of a recursive call, which bounds the stack to O(log n).
+ *
+ * Strings are sorted with an in-place MSD radix sort (American flag sort)
+ * over the bytes of the 64-bit keys. Buckets whose keys are fully equal are
+ * re-keyed with the next eight bytes of their strings, so shared prefixes
+ * like "lib" or "IMG_2024" cost one extra pass, not a strcmp per compare.
+ * As in the introsort, only the smaller buckets are sorted recursively.
+ *
+ * @license MIT
+ */
+
+#include "sort.h"
+
+#define SORT_INSERTION_MAX 16
+#define RADIX_INSERTION_MAX 32
+
+static inline int item_less(const gui_sort_item *a, const gui_sort_item *b,
+                            gui_sort_tie tie) {
+  if (a->key != b->key) {
+    return a->key < b->key;
+  }
+  return tie != NULL && tie(a->ptr, b->ptr) < 0;
+}
+
+static inline void item_swap(gui_sort_item *a, gui_sort_item *b) {
+  gui_sort_item t = *a;
+  *a = *b;
+  *b = t;
+}
+
+static void insertion_sort(gui_sort_item *items, size_t count,
+                           gui_sort_tie tie) {
+  for (size_t i = 1; i < count; ++i) {
+    gui_sort_item cur = items[i];
+    size_t j = i;
+    while (j > 0 && item_less(&cur, &items[j - 1], tie)) {
+      items[j] = items[j - 1];
+      --j;
+    }
+    items[j] = cur;
+  }
+}
+
+static void sift_down(gui_sort_item *items, size_t root, size_t count,
+                      gui_sort_tie tie) {
+  for (;;) {
+    size_t child = 2 * root + 1;
+    if (child >= count) {
+      return;
+    }
+    if (child + 1 < count && item_less(&items[child], &items[child + 1], tie)) {
+      ++child;
+    }
+    if (!item_less(&items[root], &items[child], tie)) {
+      return;
+    }
+    item_swap(&items[root], &items[child]);
+    root = child;
+  }
+}
+
+static void heap_sort(gui_sort_item *items, size_t count, gui_sort_tie tie) {
+  for (size_t i = count / 2; i-- > 0;) {
+    sift_down(items, i, count, tie);
+  }
+  for (size_t end = count; end-- > 1;) {
+    item_swap(&items[0], &items[end]);
+    sift_down(items, 0, end, tie);
+  }
+}
+
+/**
+ * @brief Partitions around the median of the first, middle and last items.
+ * @return The final index of the pivot.
+ */
+
+static size_t partition(gui_sort_item *items, size_t count, gui_sort_tie tie) {
+  size_t mid = count / 2;
+  size_t last = count - 1;
+  if (item_less(&items[mid], &items[0], tie)) {
+    item_swap(&items[mid], &items[0]);
+  }
+  if (item_less(&items[last], &items[mid], tie)) {
+    item_swap(&items[last], &items[mid]);
+    if (item_less(&items[mid], &items[0], tie)) {
+      item_swap(&items[mid], &items[0]);
+    }
+  }
+  // items[0] <= pivot <= items[last] now act as sentinels for both scans.
+  item_swap(&items[mid], &items[last - 1]);
+  gui_sort_item pivot = items[last - 1];
+
+  size_t i = 0;
+  size_t j = last - 1;
+  for (;;) {
+    while (item_less(&items[++i], &pivot, tie)) {
+    }
+    while (item_less(&pivot, &items[--j], tie)) {
+    }
+    if (i >= j) {
+      break;
+    }
+    item_swap(&items[i], &items[j]);
+  }
+  item_swap(&items[i], &items[last - 1]);
+  return i;
+}
+
+static void intro_sort(gui_sort_item *items, size_t count, gui_sort_tie tie,
+                       int depth) {
+  while (count > SORT_INSERTION_MAX) {
+    if (depth-- == 0) {
+      heap_sort(items, count, tie);
+      return;
+    }
+    size_t p = partition(items, count, tie);
+    size_t left = p;
+    size_t right = count - p - 1;
+    if (left < right) {
+      intro_sort(items, left, tie, depth);
+      items += p + 1;
+      count = right;
+    } else {
+      intro_sort(items + p + 1, right, tie, depth);
+      count = left;
+    }
+  }
+  insertion_sort(items, count, tie);
+}
+
+void gui_sort(gui_sort_item *items, size_t count, gui_sort_tie tie) {
+  int depth = 0;
+  for (size_t n = count; n > 1; n >>= 1) {
+    depth += 2;
+  }
+  intro_sort(items, count, tie, depth);
+}
+
+/*
+ * ====================
+ * =Multikey radix sort=
+ * ====================
+ */
+
+/**
+ * @brief Packs the eight bytes at 'str' (stopping at the NUL, zero padded)
+ * so that unsigned key order is byte-wise string order.
+ */
+
+static inline uint64_t key_at(const char *str) {
+  uint64_t key = 0;
+  for (int i = 0; i < 8 && str[i] != '\0'; ++i) {
+    key |= (uint64_t)(unsigned char)str[i] << (56 - 8 * i);
+  }
+  return key;
+}
+
+/**
+ * @brief Orders two strings whose first 'offset' bytes are known to match.
+ */
+
+static inline int str_less(const gui_sort_item *a, const gui_sort_item *b,
+                           size_t offset) {
+  if (a->key != b->key) {
+    return a->key < b->key;
+  }
+  if ((a->key & 0xff) == 0) {
+    return 0; // Both strings end inside this key: they are equal.
+  }
+  const char *sa = (const char *)a->ptr + offset + 8;
+  const char *sb = (const char *)b->ptr + offset + 8;
+  while (*sa != '\0' && *sa == *sb) {
+    ++sa;
+    ++sb;
+  }
+  return (unsigned char)*sa < (unsigned char)*sb;
+}
+
+static void str_insertion_sort(gui_sort_item *items, size_t count,
+                               size_t offset) {
+  for (size_t i = 1; i < count; ++i) {
+    gui_sort_item cur = items[i];
+    size_t j = i;
+    while (j > 0 && str_less(&cur, &items[j - 1], offset)) {
+      items[j] = items[j - 1];
+      --j;
+    }
+    items[j] = cur;
+  }
+}
+
+/**
+ * @brief Sorts 'items', whose strings agree on their first 'offset' bytes
+ * and whose keys agree above 'byte' (0 = most significant), by key byte
+ * 'byte' and everything after it.
+ */
+
+static void radix_sort(gui_sort_item *items, size_t count, int byte,
+                       size_t offset) {
+  for (;;) {
+    if (count <= RADIX_INSERTION_MAX) {
+      str_insertion_sort(items, count, offset);
+      return;
+    }
+
+    if (byte == 8) {
+      // All eight bytes are equal and the strings go on: re-key further in.
+      offset += 8;
+      for (size_t i = 0; i < count; ++i) {
+        items[i].key = key_at((const char *)items[i].ptr + offset);
+      }
+      byte = 0;
+    }
+
+    int shift = 56 - 8 * byte;
+    size_t counts[256] = {0};
+    for (size_t i = 0; i < count; ++i) {
+      ++counts[(items[i].key >> shift) & 0xff];
+    }
+
+    uint8_t first = (items[0].key >> shift) & 0xff;
+    if (counts[first] == count) {
+      // Everything in one bucket: nothing to move. Bucket 0 means the
+      // strings ended here, so they are all identical.
+      if (first == 0) {
+        return;
+      }
+      ++byte;
+      continue;
+    }
+
+    size_t heads[256];
+    size_t tails[256];
+    size_t pos = 0;
+    for (int d = 0; d < 256; ++d) {
+      heads[d] = pos;
+      pos += counts[d];
+      tails[d] = pos;
+    }
+    for (int d = 0; d < 256; ++d) {
+      while (heads[d] < tails[d]) {
+        gui_sort_item cur = items[heads[d]];
+        int cd = (cur.key >> shift) & 0xff;
+        while (cd != d) {
+          gui_sort_item next = items[heads[cd]];
+          items[heads[cd]++] = cur;
+          cur = next;
+          cd = (cur.key >> shift) & 0xff;
+        }
+        items[heads[d]++] = cur;
+      }
+    }
+
+    // Recurse into every bucket but the largest, which the loop takes
+    // over: each call gets at most half the items, so the depth stays
+    // below log2(count) however long the shared prefixes are.
+    int largest = 1;
+    for (int d = 2; d < 256; ++d) {
+      if (counts[d] > counts[largest]) {
+        largest = d;
+      }
+    }
+    gui_sort_item *next = items;
+    size_t start = counts[0];
+    for (int d = 1; d < 256; ++d) {
+      if (d == largest) {
+        next = items + start;
+      } else if (counts[d] > 1) {
+        radix_sort(items + start, counts[d], byte + 1, offset);
+      }
+      start += counts[d];
+    }
+    items = next;
+    count = counts[largest];
+    ++byte;
+  }
+}
+
+/**
+ * @brief Sorts items whose 'ptr' are NUL-terminated strings into byte-wise
+ * (strcmp) order. The incoming keys are ignored and overwritten.
+ */
+
+void gui_sort_strings(gui_sort_item *items, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    items[i].key = key_at((const char *)items[i].ptr);
+  }
+  radix_sort(items, count, 0, 0);
+}
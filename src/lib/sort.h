@@ -0,0 +1,32 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * In-place sort of (key, pointer) pairs.
+ *
+ * Items are ordered by 'key' first; only items with equal keys are handed to
+ * the 'tie' callback, which sees the two 'ptr' values. Packing the leading
+ * bytes of a string or a number into 'key' makes almost every
+ * comparison a single integer compare on data already in cache, instead of
+ * a pointer chase into the records being sorted.
+ *
+ * gui_sort_strings() is the specialisation for sorting by name: 'ptr' is a
+ * NUL-terminated string, and the keys are computed (and recomputed eight
+ * bytes further for runs of equal keys) by the sort itself.
+ */
+
+typedef struct gui_sort_item {
+  uint64_t key;
+  void *ptr;
+} gui_sort_item;
+
+typedef int (*gui_sort_tie)(const void *a, const void *b);
+
+void gui_sort(gui_sort_item *items, size_t count, gui_sort_tie tie);
+
+void gui_sort_strings(gui_sort_item *items, size_t count);
+
+#endif
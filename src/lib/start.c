@@ -0,0 +1,96 @@
+/*
+ * @file start.c
+ * @brief Process entry point for `make FREESTANDING=1` builds.
+ *
+ * Those builds link with -nostdlib -static: no crt1.o, no dynamic loader,
+ * no libc initialisation. The kernel enters _start with the stack holding
+ *
+ *   rsp -> argc, argv[0] .. argv[argc - 1], NULL,
+ *          envp[0] .. NULL, auxv pairs .. AT_NULL
+ *
+ * and _start turns that into main(argc, argv, envp), then hands main's
+ * result to gui_exit(), which flushes the output streams. The auxiliary
+ * vector is left alone: nothing in the tools needs it.
+ *
+ * The file also supplies the few symbols libc would otherwise provide:
+ * environ (read by mini-pwd) and the memcpy/memset/memmove/memcmp that the
+ * compiler may emit for struct copies and zeroed arrays.
+ *
+ * Default builds compile none of this and start through libc as usual.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#ifdef GUI_FREESTANDING
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lib.h"
+#include "out.h"
+
+char **environ;
+
+void *memcpy(void *dest, const void *src, size_t n) {
+  return guimemcpy(dest, src, n);
+}
+
+void *memset(void *s, int c, size_t n) { return guimemset(s, c, n); }
+
+int memcmp(const void *s1, const void *s2, size_t n) {
+  return guimemcmp(s1, s2, n);
+}
+
+// The overlapping cases copy byte by byte, in the direction that reads
+// every source byte before overwriting it; the attribute keeps the compiler
+// from turning those loops back into a memmove call.
+__attribute__((optimize("no-tree-loop-distribute-patterns"))) void *
+memmove(void *dest, const void *src, size_t n) {
+  unsigned char *d = dest;
+  const unsigned char *s = src;
+  if (d + n <= s || s + n <= d) {
+    return guimemcpy(dest, src, n);
+  }
+  if (d < s) {
+    for (size_t i = 0; i < n; ++i) {
+      d[i] = s[i];
+    }
+  } else {
+    while (n-- > 0) {
+      d[n] = s[n];
+    }
+  }
+  return dest;
+}
+
+int main(int argc, char **argv, char **envp);
+
+/**
+ * @brief Called by _start with the initial stack pointer.
+ */
+
+__attribute__((noreturn, used)) static void start_c(uintptr_t *sp) {
+  int argc = (int)sp[0];
+  char **argv = (char **)(sp + 1);
+  environ = argv + argc + 1;
+  gui_exit(main(argc, argv, environ));
+}
+
+/*
+ * rbp = 0 marks the outermost frame for debuggers. The kernel already
+ * leaves rsp 16-byte aligned; the 'and' makes sure of it, and the call
+ * then pushes the return address as the ABI expects on function entry.
+ */
+__asm__(".text\n"
+        ".global _start\n"
+        ".type _start, @function\n"
+        "_start:\n"
+        "  xor %ebp, %ebp\n"
+        "  mov %rsp, %rdi\n"
+        "  and $-16, %rsp\n"
+        "  call start_c\n"
+        "  hlt\n"
+        ".size _start, . - _start\n");
+
+#endif
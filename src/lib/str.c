@@ -0,0 +1,619 @@
+/*
+ * @file str.c
+ * @brief String functions (guilen, guicmp, guicpy, guicat and the bounded
+ * variants), vectorized.
+ *
+ * None of these kernels may read past the terminating NUL into a page that
+ * is not mapped. Three techniques keep them safe:
+ *
+ *  - guilen/guinlen only issue *aligned* vector loads. An aligned 16/32/64
+ *    byte block never straddles a page, so once it holds one byte of the
+ *    string the whole block is readable. Bytes before the start are masked
+ *    off.
+ *  - guicmp/guincmp walk two strings with unrelated alignments, so they use
+ *    unaligned loads only while neither pointer is that close to a page
+ *    end. At a page end the AVX2 kernel re-reads the last 64 bytes before
+ *    it, which are known to match; only a page end within the first 64
+ *    bytes drops to an 8 byte word-at-a-time (SWAR) step and single bytes.
+ *  - The AVX-512 kernels use masked loads there instead, which do not fault
+ *    on the bytes they leave out.
+ *
+ * Long strings go 128 bytes per loop iteration (guilen) or 64 to 128
+ * (guicmp); the first block is tested on its own, since d_name-sized
+ * strings end there.
+ *
+ * SSE2, AVX2 and AVX-512 kernels are picked at first use, like the ones in
+ * mem.c.
+ *
+ * @license MIT
+ */
+
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "lib.h"
+
+#define PAGE_SIZE 4096
+
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+
+typedef uint64_t u64_u __attribute__((aligned(1), may_alias));
+
+typedef size_t (*strlen_fn)(const char *);
+typedef int (*strcmp_fn)(const unsigned char *, const unsigned char *, size_t);
+
+static size_t len_resolve(const char *str);
+static int cmp_resolve(const unsigned char *s1, const unsigned char *s2,
+                       size_t n);
+static void resolve_all(void);
+
+static strlen_fn _len_impl = len_resolve;
+static strcmp_fn _cmp_impl = cmp_resolve;
+
+/*
+ * ==========
+ * =Dispatch=
+ * ==========
+ */
+
+static size_t len_sse2(const char *str);
+static size_t len_avx2(const char *str);
+static size_t len_avx512(const char *str);
+static int cmp_sse2(const unsigned char *s1, const unsigned char *s2,
+                    size_t n);
+static int cmp_avx2(const unsigned char *s1, const unsigned char *s2,
+                    size_t n);
+static int cmp_avx512(const unsigned char *s1, const unsigned char *s2,
+                      size_t n);
+
+/**
+ * @brief Binds the guilen/guicmp kernels for the running CPU on first use.
+ */
+
+static void resolve_all(void) {
+  unsigned f = gui_cpu_features();
+  if (f & GUI_CPU_AVX512) {
+    _len_impl = len_avx512;
+    _cmp_impl = cmp_avx512;
+  } else if (f & GUI_CPU_AVX2) {
+    _len_impl = len_avx2;
+    _cmp_impl = cmp_avx2;
+  } else {
+    _len_impl = len_sse2;
+    _cmp_impl = cmp_sse2;
+  }
+}
+
+/*
+ * =========
+ * =Lengths=
+ * =========
+ */
+
+static size_t len_sse2(const char *str) {
+  uintptr_t skew = (uintptr_t)str & 15;
+  const __m128i *p = (const __m128i *)(str - skew);
+  __m128i zero = _mm_setzero_si128();
+
+  unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(*p, zero)) >> skew;
+  if (m != 0) {
+    return __builtin_ctz(m);
+  }
+  for (;;) {
+    ++p;
+    m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(*p, zero));
+    if (m != 0) {
+      return (const char *)p + __builtin_ctz(m) - str;
+    }
+  }
+}
+
+__attribute__((target("avx2"))) static size_t len_avx2(const char *str) {
+  uintptr_t skew = (uintptr_t)str & 31;
+  const __m256i *p = (const __m256i *)(str - skew);
+  __m256i zero = _mm256_setzero_si256();
+
+  unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(*p, zero)) >>
+               skew;
+  if (m != 0) {
+    return __builtin_ctz(m);
+  }
+  // Single blocks up to a 128 byte boundary: d_name-sized strings end here.
+  while (((uintptr_t)++p & 127) != 0) {
+    m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(*p, zero));
+    if (m != 0) {
+      return (const char *)p + __builtin_ctz(m) - str;
+    }
+  }
+  // Four blocks per iteration; an aligned 128 byte group never crosses a
+  // page. The unsigned minimum of the four is zero wherever any of them is.
+  for (;; p += 4) {
+    __m256i min = _mm256_min_epu8(_mm256_min_epu8(p[0], p[1]),
+                                  _mm256_min_epu8(p[2], p[3]));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(min, zero)) != 0) {
+      break;
+    }
+  }
+  for (;; ++p) {
+    m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(*p, zero));
+    if (m != 0) {
+      return (const char *)p + __builtin_ctz(m) - str;
+    }
+  }
+}
+
+__attribute__((target("avx512f,avx512bw"))) static size_t
+len_avx512(const char *str) {
+  uintptr_t skew = (uintptr_t)str & 63;
+  const __m512i *p = (const __m512i *)(str - skew);
+
+  uint64_t m = _mm512_testn_epi8_mask(*p, *p) >> skew;
+  if (m != 0) {
+    return __builtin_ctzll(m);
+  }
+  ++p;
+  if ((uintptr_t)p & 64) {
+    m = _mm512_testn_epi8_mask(*p, *p);
+    if (m != 0) {
+      return (const char *)p + __builtin_ctzll(m) - str;
+    }
+    ++p;
+  }
+  // Two blocks per iteration, as in len_avx2().
+  for (;; p += 2) {
+    __m512i min = _mm512_min_epu8(p[0], p[1]);
+    if (_mm512_testn_epi8_mask(min, min) != 0) {
+      break;
+    }
+  }
+  m = _mm512_testn_epi8_mask(p[0], p[0]);
+  if (m != 0) {
+    return (const char *)p + __builtin_ctzll(m) - str;
+  }
+  m = _mm512_testn_epi8_mask(p[1], p[1]);
+  return (const char *)(p + 1) + __builtin_ctzll(m) - str;
+}
+
+static size_t len_resolve(const char *str) {
+  resolve_all();
+  return _len_impl(str);
+}
+
+/**
+ * @brief Calculates the length of a null-terminated string.
+ *
+ * (equivalent to strlen)
+ */
+
+size_t guilen(const char *str) { return _len_impl(str); }
+
+/**
+ * @brief Calculates the lenght of a string, limiting it to a search of 'maxlen'
+ * bytes (Equivalent to strnlen)
+ *
+ * Aligned 16 byte blocks may look past 'maxlen', but never past the page
+ * that holds the last byte we are allowed to read.
+ */
+
+size_t guinlen(const char *str, size_t maxlen) {
+  if (maxlen == 0) {
+    return 0;
+  }
+  uintptr_t skew = (uintptr_t)str & 15;
+  const __m128i *p = (const __m128i *)(str - skew);
+  __m128i zero = _mm_setzero_si128();
+
+  unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(*p, zero)) >> skew;
+  size_t len = 16 - skew;
+  if (m != 0) {
+    len = __builtin_ctz(m);
+    return len < maxlen ? len : maxlen;
+  }
+  while (len < maxlen) {
+    ++p;
+    m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(*p, zero));
+    if (m != 0) {
+      len += __builtin_ctz(m);
+      break;
+    }
+    len += 16;
+  }
+  return len < maxlen ? len : maxlen;
+}
+
+/*
+ * =============
+ * =Comparisons=
+ * =============
+ */
+
+/**
+ * @brief Bytes left before either string reaches the end of its page. Every
+ * load inside that window is safe without further checks.
+ */
+
+static inline size_t page_room(const unsigned char *s1,
+                               const unsigned char *s2) {
+  size_t room1 = PAGE_SIZE - ((uintptr_t)s1 & (PAGE_SIZE - 1));
+  size_t room2 = PAGE_SIZE - ((uintptr_t)s2 & (PAGE_SIZE - 1));
+  return room1 < room2 ? room1 : room2;
+}
+
+/**
+ * @brief Index of the first byte in a 16 byte block where 'a' and 'b'
+ * differ or 'a' is NUL, or 16 when there is none.
+ *
+ * min(a, a == b) is zero exactly at those bytes, which saves a separate NUL
+ * compare.
+ */
+
+static inline unsigned stop_sse2(const unsigned char *s1,
+                                 const unsigned char *s2) {
+  __m128i a = _mm_loadu_si128((const __m128i *)s1);
+  __m128i b = _mm_loadu_si128((const __m128i *)s2);
+  __m128i z = _mm_min_epu8(a, _mm_cmpeq_epi8(a, b));
+  unsigned m = (unsigned)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(z, _mm_setzero_si128()));
+  return m != 0 ? (unsigned)__builtin_ctz(m) : 16;
+}
+
+/**
+ * @brief SWAR version of stop_sse2() for one 8 byte word. The zero-byte test
+ * can flag bytes above a real NUL, but its lowest set bit is always exact.
+ */
+
+static inline unsigned stop_swar(const unsigned char *s1,
+                                 const unsigned char *s2) {
+  uint64_t a = *(const u64_u *)s1;
+  uint64_t diff = a ^ *(const u64_u *)s2;
+  uint64_t nul = (a - SWAR_ONES) & ~a & SWAR_HIGHS;
+  unsigned i = diff != 0 ? (unsigned)__builtin_ctzll(diff) >> 3 : 8;
+  unsigned j = nul != 0 ? (unsigned)__builtin_ctzll(nul) >> 3 : 8;
+  return i < j ? i : j;
+}
+
+/**
+ * @brief Walks the last 'room' (< 16) bytes of a page with one SWAR word and
+ * then single bytes.
+ *
+ * @return 1 with the result in '*res' when the comparison is decided, 0 when
+ * the caller should carry on from the next page.
+ */
+
+static inline int cmp_edge(const unsigned char **ps1,
+                           const unsigned char **ps2, size_t *pn, size_t room,
+                           int *res) {
+  const unsigned char *s1 = *ps1, *s2 = *ps2;
+  size_t n = *pn;
+  *res = 0;
+
+  if (room >= 8) {
+    unsigned i = stop_swar(s1, s2);
+    if (i < 8) {
+      *res = i < n ? (int)s1[i] - (int)s2[i] : 0;
+      return 1;
+    }
+    if (n <= 8) {
+      return 1;
+    }
+    s1 += 8;
+    s2 += 8;
+    n -= 8;
+    room -= 8;
+  }
+  for (; room > 0; --room) {
+    if (n == 0) {
+      return 1;
+    }
+    if (*s1 != *s2 || *s1 == '\0') {
+      *res = (int)*s1 - (int)*s2;
+      return 1;
+    }
+    ++s1;
+    ++s2;
+    --n;
+  }
+  *ps1 = s1;
+  *ps2 = s2;
+  *pn = n;
+  return n == 0;
+}
+
+/**
+ * @brief Compares the first 'n' bytes of two strings, stopping at the first
+ * NUL. 'n' == SIZE_MAX makes this an unbounded guicmp.
+ */
+
+static int cmp_sse2(const unsigned char *s1, const unsigned char *s2,
+                    size_t n) {
+  int res;
+  while (n > 0) {
+    size_t room = page_room(s1, s2);
+    for (; room >= 16; room -= 16) {
+      unsigned i = stop_sse2(s1, s2);
+      if (i < 16) {
+        return i < n ? (int)s1[i] - (int)s2[i] : 0;
+      }
+      if (n <= 16) {
+        return 0;
+      }
+      s1 += 16;
+      s2 += 16;
+      n -= 16;
+    }
+    if (cmp_edge(&s1, &s2, &n, room, &res)) {
+      return res;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Stop bytes (as for stop_sse2()) of a 32 byte block, as a bit mask.
+ */
+
+__attribute__((target("avx2"))) static inline unsigned
+stops_avx2(const unsigned char *s1, const unsigned char *s2) {
+  __m256i a = _mm256_loadu_si256((const __m256i *)s1);
+  __m256i b = _mm256_loadu_si256((const __m256i *)s2);
+  __m256i z = _mm256_min_epu8(a, _mm256_cmpeq_epi8(a, b));
+  return (unsigned)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(z, _mm256_setzero_si256()));
+}
+
+__attribute__((target("avx2"))) static inline uint64_t
+stops64_avx2(const unsigned char *s1, const unsigned char *s2) {
+  return stops_avx2(s1, s2) | (uint64_t)stops_avx2(s1 + 32, s2 + 32) << 32;
+}
+
+/**
+ * @brief Whether a 64 byte block holds any stop byte: one test for both
+ * halves, the exact position is left to stops64_avx2().
+ */
+
+__attribute__((target("avx2"))) static inline int
+any_stop64_avx2(const unsigned char *s1, const unsigned char *s2) {
+  __m256i a0 = _mm256_loadu_si256((const __m256i *)s1);
+  __m256i a1 = _mm256_loadu_si256((const __m256i *)(s1 + 32));
+  __m256i z0 = _mm256_min_epu8(
+      a0, _mm256_cmpeq_epi8(a0, _mm256_loadu_si256((const __m256i *)s2)));
+  __m256i z1 = _mm256_min_epu8(
+      a1,
+      _mm256_cmpeq_epi8(a1, _mm256_loadu_si256((const __m256i *)(s2 + 32))));
+  __m256i z = _mm256_cmpeq_epi8(_mm256_min_epu8(z0, z1),
+                                _mm256_setzero_si256());
+  return !_mm256_testz_si256(z, z);
+}
+
+/*
+ * 128 bytes per iteration while both strings are that far from a page end,
+ * then 64 at a time. 's1' is first brought to a 64 byte boundary, so half
+ * the loads never split a cache line. At a page end, once 64 bytes are
+ * behind us (mapped, matching, no NUL), one 64 byte block ending exactly
+ * at the nearer page end finishes the page: the bytes it reads again
+ * cannot stop the compare. Only a page end within the first 64 bytes takes
+ * the narrow path.
+ */
+__attribute__((target("avx2"))) static int
+cmp_avx2(const unsigned char *s1, const unsigned char *s2, size_t n) {
+  const unsigned char *start = s1;
+  int res;
+  if (n > 64 && page_room(s1, s2) >= 128) {
+    // One unaligned block, then step to the next 64 byte boundary of 's1'
+    // (re-reading a few matched bytes) so its loads never split a line.
+    if (any_stop64_avx2(s1, s2)) {
+      size_t i = (size_t)__builtin_ctzll(stops64_avx2(s1, s2));
+      return (int)s1[i] - (int)s2[i];
+    }
+    size_t skip = 64 - ((uintptr_t)s1 & 63);
+    s1 += skip;
+    s2 += skip;
+    n -= skip;
+  }
+  while (n > 0) {
+    size_t room = page_room(s1, s2);
+    for (; room >= 128 && n > 128; room -= 128) {
+      if (any_stop64_avx2(s1, s2) | any_stop64_avx2(s1 + 64, s2 + 64)) {
+        break;
+      }
+      s1 += 128;
+      s2 += 128;
+      n -= 128;
+    }
+    for (; room >= 64; room -= 64) {
+      if (any_stop64_avx2(s1, s2)) {
+        size_t i = (size_t)__builtin_ctzll(stops64_avx2(s1, s2));
+        return i < n ? (int)s1[i] - (int)s2[i] : 0;
+      }
+      if (n <= 64) {
+        return 0;
+      }
+      s1 += 64;
+      s2 += 64;
+      n -= 64;
+    }
+    if (room == 0) {
+      continue;
+    }
+    if ((size_t)(s1 - start) >= 64) {
+      size_t back = 64 - room;
+      uint64_t m = stops64_avx2(s1 - back, s2 - back) >> back;
+      if (m != 0) {
+        size_t i = (size_t)__builtin_ctzll(m);
+        return i < n ? (int)s1[i] - (int)s2[i] : 0;
+      }
+      if (n <= room) {
+        return 0;
+      }
+      s1 += room;
+      s2 += room;
+      n -= room;
+      continue;
+    }
+    for (; room >= 16; room -= 16) {
+      unsigned i = stop_sse2(s1, s2);
+      if (i < 16) {
+        return i < n ? (int)s1[i] - (int)s2[i] : 0;
+      }
+      if (n <= 16) {
+        return 0;
+      }
+      s1 += 16;
+      s2 += 16;
+      n -= 16;
+    }
+    if (cmp_edge(&s1, &s2, &n, room, &res)) {
+      return res;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Bytes of a 64 byte block where the strings match and 's1' is not
+ * NUL, as a bit mask; the stop bytes are the clear bits. 'k' selects the
+ * bytes to load: masked-out bytes are not read, and cannot fault.
+ */
+
+__attribute__((target("avx512f,avx512bw"))) static inline uint64_t
+good_avx512(const unsigned char *s1, const unsigned char *s2, __mmask64 k) {
+  __m512i a = _mm512_maskz_loadu_epi8(k, s1);
+  __m512i b = _mm512_maskz_loadu_epi8(k, s2);
+  return _mm512_mask_cmpeq_epi8_mask(_mm512_test_epi8_mask(a, a), a, b);
+}
+
+/*
+ * 128 bytes per iteration away from page ends. The last bytes of a page
+ * are compared with one masked load, which does not fault on the bytes it
+ * leaves out, so there is no narrow path at all.
+ */
+__attribute__((target("avx512f,avx512bw"))) static int
+cmp_avx512(const unsigned char *s1, const unsigned char *s2, size_t n) {
+  if (page_room(s1, s2) >= 64) {
+    // Most names end in the first block: try it before the wide loop.
+    uint64_t stop = ~good_avx512(s1, s2, ~0ULL);
+    if (stop != 0) {
+      size_t i = (size_t)__builtin_ctzll(stop);
+      return i < n ? (int)s1[i] - (int)s2[i] : 0;
+    }
+    if (n <= 64) {
+      return 0;
+    }
+    s1 += 64;
+    s2 += 64;
+    n -= 64;
+  }
+  while (n > 0) {
+    size_t room = page_room(s1, s2);
+    for (; room >= 128 && n > 128; room -= 128) {
+      if ((good_avx512(s1, s2, ~0ULL) &
+           good_avx512(s1 + 64, s2 + 64, ~0ULL)) != ~0ULL) {
+        break;
+      }
+      s1 += 128;
+      s2 += 128;
+      n -= 128;
+    }
+    while (room > 0) {
+      size_t step = room < 64 ? room : 64;
+      __mmask64 k = step == 64 ? ~0ULL : (1ULL << step) - 1;
+      uint64_t stop = ~good_avx512(s1, s2, k) & k;
+      if (stop != 0) {
+        size_t i = (size_t)__builtin_ctzll(stop);
+        return i < n ? (int)s1[i] - (int)s2[i] : 0;
+      }
+      if (n <= step) {
+        return 0;
+      }
+      s1 += step;
+      s2 += step;
+      n -= step;
+      room -= step;
+    }
+  }
+  return 0;
+}
+
+static int cmp_resolve(const unsigned char *s1, const unsigned char *s2,
+                       size_t n) {
+  resolve_all();
+  return _cmp_impl(s1, s2, n);
+}
+
+int guicmp(const char *s1, const char *s2) {
+  return _cmp_impl((const unsigned char *)s1, (const unsigned char *)s2,
+                   SIZE_MAX);
+}
+
+int guincmp(const char *s1, const char *s2, size_t n) {
+  return _cmp_impl((const unsigned char *)s1, (const unsigned char *)s2, n);
+}
+
+/*
+ * ========
+ * =Copies=
+ * ========
+ */
+
+/**
+ * @brief Copies the string of 'src' to 'dest'.
+ * (Equivalent to strcpy)
+ * @return Return 'dest'.
+ */
+
+char *guicpy(char *dest, const char *src) {
+  guimemcpy(dest, src, guilen(src) + 1);
+  return dest;
+}
+
+/**
+ * @brief Copies a maximum of 'n' bytes from 'src' to 'dest'.
+ * (equivalent to strncpy)
+ *
+ * WARNING: strncpy has a peculiar behavior - if the length of 'src'
+ * is less than 'n', the remainder of 'dest' is padded with '\0'.
+ * This implementation replicates this behavior.
+ *
+ * @return Returns 'dest'.
+ */
+
+char *guincpy(char *dest, const char *src, size_t n) {
+  size_t len = guinlen(src, n);
+  guimemcpy(dest, src, len);
+  guimemset(dest + len, '\0', n - len);
+  return dest;
+}
+
+/**
+ * @brief Adds 'src' at the end of 'dest'.
+ * (Equivalent to strcat)
+ *
+ * The end of 'dest' is found with one vectorized guilen() pass and 'src' is
+ * appended with a single guimemcpy().
+ *
+ * @return Returns 'dest'.
+ */
+
+char *guicat(char *dest, const char *src) {
+  guicpy(dest + guilen(dest), src);
+  return dest;
+}
+
+/**
+ * @brief Adds at most 'n' bytes of 'src' to the end of 'dest'.
+ * (Equivalent to strncat)
+ *
+ * Ensures that the result ends in zero.
+ *
+ * @return Returns 'dest'.
+ */
+
+char *guincat(char *dest, const char *src, size_t n) {
+  char *end = dest + guilen(dest);
+  size_t len = guinlen(src, n);
+  guimemcpy(end, src, len);
+  end[len] = '\0';
+  return dest;
+}
@@ -7,17 +7,117 @@
 extern "C" {
 #endif
 
-int64_t _guicall_impl(int64_t num, 
-                      int64_t arg1, int64_t arg2, int64_t arg3,
-                      int64_t arg4, int64_t arg5, int64_t arg6);
+/*
+ * Raw x86-64 Linux system calls. guicall(num, args...) picks the wrapper
+ * for its argument count at compile time; each wrapper is a static inline
+ * function around a single `syscall` instruction, so a call site costs the
+ * register moves for the arguments it actually has and nothing else.
+ *
+ * Only rax, rcx and r11 are clobbered by the instruction itself. "memory"
+ * stays because the kernel reads and writes through pointer arguments
+ * (read buffers, stat structures), which the compiler cannot see.
+ *
+ * Every wrapper returns the raw kernel result: a value >= 0 on success,
+ * -errno on failure. errno is never set; gui_errno() turns a result into
+ * an error number.
+ *
+ * Built with -DGUI_SYSSTATS (`make SYSSTATS=1`), every guicall() goes
+ * through _guicall_counted() instead, which keeps per-syscall counts and
+ * latencies (see sysstats.c).
+ */
+
+#define GUI_MAX_ERRNO 4095
+
+/**
+ * @brief The error number of a guicall() result: 'ret' negated when it is
+ * in the -4095..-1 error range, 0 for a success.
+ */
+
+static inline int gui_errno(int64_t ret) {
+  return ret < 0 && ret >= -GUI_MAX_ERRNO ? (int)-ret : 0;
+}
+
+static inline int64_t _guicall0(int64_t num) {
+  int64_t ret;
+  __asm__ volatile("syscall"
+                   : "=a"(ret)
+                   : "a"(num)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
+
+static inline int64_t _guicall1(int64_t num, int64_t a1) {
+  int64_t ret;
+  __asm__ volatile("syscall"
+                   : "=a"(ret)
+                   : "a"(num), "D"(a1)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
+
+static inline int64_t _guicall2(int64_t num, int64_t a1, int64_t a2) {
+  int64_t ret;
+  __asm__ volatile("syscall"
+                   : "=a"(ret)
+                   : "a"(num), "D"(a1), "S"(a2)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
+
+static inline int64_t _guicall3(int64_t num, int64_t a1, int64_t a2,
+                                int64_t a3) {
+  int64_t ret;
+  __asm__ volatile("syscall"
+                   : "=a"(ret)
+                   : "a"(num), "D"(a1), "S"(a2), "d"(a3)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
+
+static inline int64_t _guicall4(int64_t num, int64_t a1, int64_t a2,
+                                int64_t a3, int64_t a4) {
+  int64_t ret;
+  register int64_t r10 __asm__("r10") = a4;
+  __asm__ volatile("syscall"
+                   : "=a"(ret)
+                   : "a"(num), "D"(a1), "S"(a2), "d"(a3), "r"(r10)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
 
+static inline int64_t _guicall5(int64_t num, int64_t a1, int64_t a2,
+                                int64_t a3, int64_t a4, int64_t a5) {
+  int64_t ret;
+  register int64_t r10 __asm__("r10") = a4;
+  register int64_t r8 __asm__("r8") = a5;
+  __asm__ volatile("syscall"
+                   : "=a"(ret)
+                   : "a"(num), "D"(a1), "S"(a2), "d"(a3), "r"(r10), "r"(r8)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
+
+static inline int64_t _guicall6(int64_t num, int64_t a1, int64_t a2,
+                                int64_t a3, int64_t a4, int64_t a5,
+                                int64_t a6) {
+  int64_t ret;
+  register int64_t r10 __asm__("r10") = a4;
+  register int64_t r8 __asm__("r8") = a5;
+  register int64_t r9 __asm__("r9") = a6;
+  __asm__ volatile("syscall"
+                   : "=a"(ret)
+                   : "a"(num), "D"(a1), "S"(a2), "d"(a3), "r"(r10), "r"(r8),
+                     "r"(r9)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
 
 #define _GUICALL_CONCAT(a, b) a ## b
 #define _GUICALL_CONCAT_INNER(a, b) _GUICALL_CONCAT(a, b)
 
 #define _GUICALL_NUM_ARGS(...) \
     _GUICALL_NUM_ARGS_IMPL(0, __VA_ARGS__, 7, 6, 5, 4, 3, 2, 1, 0)
-    
+
 #define _GUICALL_NUM_ARGS_IMPL(_0, _1, _2, _3, _4, _5, _6, _7, N, ...) N
 
 
@@ -34,14 +134,31 @@ int64_t _guicall_impl(int64_t num,
 
 
 
-#define guicall0(num) _guicall_impl((int64_t)(num), 0, 0, 0, 0, 0, 0)
-#define guicall1(num, a1) _guicall_impl((int64_t)(num), (int64_t)(a1), 0, 0, 0, 0, 0)
-#define guicall2(num, a1, a2) _guicall_impl((int64_t)(num), (int64_t)(a1), (int64_t)(a2), 0, 0, 0, 0)
-#define guicall3(num, a1, a2, a3) _guicall_impl((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), 0, 0, 0)
-#define guicall4(num, a1, a2, a3, a4) _guicall_impl((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4), 0, 0)
-#define guicall5(num, a1, a2, a3, a4, a5) _guicall_impl((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4), (int64_t)(a5), 0)
-#define guicall6(num, a1, a2, a3, a4, a5, a6) _guicall_impl((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4), (int64_t)(a5), (int64_t)(a6))
+#ifdef GUI_SYSSTATS
 
+int64_t _guicall_counted(int64_t num, int64_t a1, int64_t a2, int64_t a3,
+                         int64_t a4, int64_t a5, int64_t a6);
+void gui_sysstats_report(void);
+
+#define guicall0(num) _guicall_counted((int64_t)(num), 0, 0, 0, 0, 0, 0)
+#define guicall1(num, a1) _guicall_counted((int64_t)(num), (int64_t)(a1), 0, 0, 0, 0, 0)
+#define guicall2(num, a1, a2) _guicall_counted((int64_t)(num), (int64_t)(a1), (int64_t)(a2), 0, 0, 0, 0)
+#define guicall3(num, a1, a2, a3) _guicall_counted((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), 0, 0, 0)
+#define guicall4(num, a1, a2, a3, a4) _guicall_counted((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4), 0, 0)
+#define guicall5(num, a1, a2, a3, a4, a5) _guicall_counted((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4), (int64_t)(a5), 0)
+#define guicall6(num, a1, a2, a3, a4, a5, a6) _guicall_counted((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4), (int64_t)(a5), (int64_t)(a6))
+
+#else
+
+#define guicall0(num) _guicall0((int64_t)(num))
+#define guicall1(num, a1) _guicall1((int64_t)(num), (int64_t)(a1))
+#define guicall2(num, a1, a2) _guicall2((int64_t)(num), (int64_t)(a1), (int64_t)(a2))
+#define guicall3(num, a1, a2, a3) _guicall3((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3))
+#define guicall4(num, a1, a2, a3, a4) _guicall4((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4))
+#define guicall5(num, a1, a2, a3, a4, a5) _guicall5((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4), (int64_t)(a5))
+#define guicall6(num, a1, a2, a3, a4, a5, a6) _guicall6((int64_t)(num), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3), (int64_t)(a4), (int64_t)(a5), (int64_t)(a6))
+
+#endif
 
 #define guicall(...) \
     _GUICALL_OVERLOAD_FINAL(guicall, _GUICALL_NUM_ARGS(__VA_ARGS__), __VA_ARGS__)
@@ -336,32 +336,32 @@
 #define SYS_statx       332
 #define SYS_io_pgetevents 333
 #define SYS_rseq        334
-#define SYS_pidfd_send_signal 335
-#define SYS_io_uring_setup 336
-#define SYS_io_uring_enter 337
-#define SYS_io_uring_register 338
-#define SYS_open_tree   339
-#define SYS_move_mount  340
-#define SYS_fsopen      341
-#define SYS_fsconfig    342
-#define SYS_fsmount     343
-#define SYS_fspick      344
-#define SYS_pidfd_open  345
-#define SYS_clone3      346
-#define SYS_close_range 347
-#define SYS_openat2     348
-#define SYS_pidfd_getfd 349
-#define SYS_faccessat2  350
-#define SYS_process_madvise 351
-#define SYS_epoll_pwait2 352
-#define SYS_mount_setattr 353
-#define SYS_quotactl_fd 354
-#define SYS_landlock_create_ruleset 355
-#define SYS_landlock_add_rule 356
-#define SYS_landlock_restrict_self 357
-#define SYS_memfd_secret 358
-#define SYS_process_mrelease 359
-#define SYS_futex_waitv 360
-#define SYS_set_mempolicy_home_node 361
+#define SYS_pidfd_send_signal 424
+#define SYS_io_uring_setup 425
+#define SYS_io_uring_enter 426
+#define SYS_io_uring_register 427
+#define SYS_open_tree   428
+#define SYS_move_mount  429
+#define SYS_fsopen      430
+#define SYS_fsconfig    431
+#define SYS_fsmount     432
+#define SYS_fspick      433
+#define SYS_pidfd_open  434
+#define SYS_clone3      435
+#define SYS_close_range 436
+#define SYS_openat2     437
+#define SYS_pidfd_getfd 438
+#define SYS_faccessat2  439
+#define SYS_process_madvise 440
+#define SYS_epoll_pwait2 441
+#define SYS_mount_setattr 442
+#define SYS_quotactl_fd 443
+#define SYS_landlock_create_ruleset 444
+#define SYS_landlock_add_rule 445
+#define SYS_landlock_restrict_self 446
+#define SYS_memfd_secret 447
+#define SYS_process_mrelease 448
+#define SYS_futex_waitv 449
+#define SYS_set_mempolicy_home_node 450
 
 #endif
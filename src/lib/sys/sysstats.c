@@ -0,0 +1,292 @@
+/*
+ * @file sysstats.c
+ * @brief Per-syscall accounting for builds made with `make SYSSTATS=1`.
+ *
+ * In such builds guicall() goes through _guicall_counted(), which reads
+ * the TSC around the syscall instruction and adds the call to the slot of
+ * its number: calls, errors, bytes moved (for the calls that return a byte
+ * count) and a log2 histogram of the cycles it took. Slots are updated with
+ * relaxed atomics, so the workers of mini-ls --threads are counted too.
+ *
+ * gui_exit() calls gui_sysstats_report(), which prints the table to stderr
+ * when the environment has MINI_STATS=1. Cycles are converted to time with
+ * the TSC rate measured between the first counted call and the report.
+ *
+ * Default builds compile none of this: guicall() stays the inline syscall.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#ifdef GUI_SYSSTATS
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "fmt.h"
+#include "lib.h"
+#include "out.h"
+#include "sys/guicall.h"
+#include "sys/sysnums.h"
+
+// Above every x86-64 syscall number in use; the last slot takes any other.
+#define SYSSTATS_SLOTS 512
+#define SYSSTATS_BUCKETS 40
+
+#define CLOCK_MONOTONIC 1
+
+typedef struct {
+  uint64_t calls;
+  uint64_t errors;
+  uint64_t bytes;
+  uint64_t cycles;
+  uint64_t hist[SYSSTATS_BUCKETS]; // hist[k]: calls of 2^k to 2^(k+1) cycles.
+} SysStat;
+
+static SysStat stats[SYSSTATS_SLOTS];
+static uint64_t start_tsc;
+static uint64_t start_ns;
+
+// Names of the syscalls the tools make; others are printed by number.
+static const char *const names[SYSSTATS_SLOTS] = {
+    [SYS_read] = "read",
+    [SYS_write] = "write",
+    [SYS_open] = "open",
+    [SYS_close] = "close",
+    [SYS_fstat] = "fstat",
+    [SYS_lseek] = "lseek",
+    [SYS_mmap] = "mmap",
+    [SYS_mprotect] = "mprotect",
+    [SYS_munmap] = "munmap",
+    [SYS_ioctl] = "ioctl",
+    [SYS_writev] = "writev",
+    [SYS_mremap] = "mremap",
+    [SYS_madvise] = "madvise",
+    [SYS_sendfile] = "sendfile",
+    [SYS_clone] = "clone",
+    [SYS_exit] = "exit",
+    [SYS_getcwd] = "getcwd",
+    [SYS_futex] = "futex",
+    [SYS_getdents64] = "getdents64",
+    [SYS_clock_gettime] = "clock_gettime",
+    [SYS_exit_group] = "exit_group",
+    [SYS_openat] = "openat",
+    [SYS_newfstatat] = "newfstatat",
+    [SYS_readlinkat] = "readlinkat",
+    [SYS_splice] = "splice",
+    [SYS_prlimit64] = "prlimit64",
+    [SYS_copy_file_range] = "copy_file_range",
+    [SYS_statx] = "statx",
+    [SYS_io_uring_setup] = "io_uring_setup",
+    [SYS_io_uring_enter] = "io_uring_enter",
+};
+
+static inline uint64_t rdtsc(void) {
+  uint32_t lo, hi;
+  __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static uint64_t clock_ns(void) {
+  int64_t ts[2];
+  _guicall2(SYS_clock_gettime, CLOCK_MONOTONIC, (int64_t)ts);
+  return (uint64_t)ts[0] * 1000000000 + (uint64_t)ts[1];
+}
+
+/**
+ * @brief Whether a successful 'num' returns the number of bytes it moved.
+ */
+
+static int moves_bytes(int64_t num) {
+  switch (num) {
+  case SYS_read:
+  case SYS_write:
+  case SYS_writev:
+  case SYS_getdents64:
+  case SYS_sendfile:
+  case SYS_splice:
+  case SYS_copy_file_range:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static inline void add(uint64_t *counter, uint64_t n) {
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+int64_t _guicall_counted(int64_t num, int64_t a1, int64_t a2, int64_t a3,
+                         int64_t a4, int64_t a5, int64_t a6) {
+  if (__atomic_load_n(&start_tsc, __ATOMIC_RELAXED) == 0) {
+    uint64_t zero = 0;
+    uint64_t ns = clock_ns();
+    if (__atomic_compare_exchange_n(&start_tsc, &zero, rdtsc(), 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      start_ns = ns;
+    }
+  }
+
+  uint64_t t0 = rdtsc();
+  int64_t ret = _guicall6(num, a1, a2, a3, a4, a5, a6);
+  uint64_t cycles = rdtsc() - t0;
+
+  SysStat *s = &stats[(uint64_t)num < SYSSTATS_SLOTS ? num : SYSSTATS_SLOTS - 1];
+  add(&s->calls, 1);
+  add(&s->cycles, cycles);
+  if (gui_errno(ret) != 0) {
+    add(&s->errors, 1);
+  } else if (ret > 0 && moves_bytes(num)) {
+    add(&s->bytes, (uint64_t)ret);
+  }
+  unsigned bucket = 63 - __builtin_clzll(cycles | 1);
+  add(&s->hist[bucket < SYSSTATS_BUCKETS ? bucket : SYSSTATS_BUCKETS - 1], 1);
+  return ret;
+}
+
+/*
+ * ========
+ * =Report=
+ * ========
+ */
+
+/**
+ * @brief Whether the environment has MINI_STATS=1. Read from
+ * /proc/self/environ, which works whether or not libc set up environ.
+ */
+
+static int stats_requested(void) {
+  static char env[1024 * 32];
+  int fd = (int)_guicall3(SYS_openat, AT_FDCWD, (int64_t) "/proc/self/environ",
+                          0);
+  if (fd < 0) {
+    return 0;
+  }
+  int64_t len = _guicall3(SYS_read, fd, (int64_t)env, sizeof(env) - 1);
+  _guicall1(SYS_close, fd);
+  for (int64_t i = 0; i < len; i += guilen(env + i) + 1) {
+    if (guicmp(env + i, "MINI_STATS=1") == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void put_field(gui_out *out, const char *text, size_t len,
+                      size_t width) {
+  char field[GUI_FMT_MAX];
+  gui_out_write(out, field, gui_fmt_pad(field, text, len, width));
+}
+
+static void put_num(gui_out *out, uint64_t v, size_t width) {
+  char num[GUI_FMT_MAX];
+  put_field(out, num, gui_fmt_u64(num, v), width);
+}
+
+static void put_name(gui_out *out, int64_t num) {
+  size_t len;
+  if (names[num] != NULL) {
+    len = guilen(names[num]);
+    gui_out_write(out, names[num], len);
+  } else {
+    gui_out_str(out, "syscall_");
+    gui_out_unum(out, (uint64_t)num);
+    len = 8 + gui_fmt_digits((uint64_t)num);
+  }
+  while (len++ < 16) {
+    gui_out_char(out, ' ');
+  }
+}
+
+/**
+ * @brief Upper bound, in cycles, of the bucket holding the 'q'-th quantile
+ * (in thousandths) of a histogram of 'total' calls.
+ */
+
+static uint64_t quantile(const uint64_t *hist, uint64_t total, unsigned q) {
+  uint64_t rank = (total * q + 999) / 1000;
+  uint64_t seen = 0;
+  for (unsigned k = 0; k < SYSSTATS_BUCKETS; ++k) {
+    seen += hist[k];
+    if (seen >= rank) {
+      return (uint64_t)2 << k;
+    }
+  }
+  return (uint64_t)1 << SYSSTATS_BUCKETS;
+}
+
+void gui_sysstats_report(void) {
+  if (start_tsc == 0 || !stats_requested()) {
+    return;
+  }
+  // Snapshot first: printing the report makes syscalls of its own.
+  static SysStat snap[SYSSTATS_SLOTS];
+  guimemcpy(snap, stats, sizeof(snap));
+  uint64_t elapsed_ns = clock_ns() - start_ns;
+  uint64_t elapsed_tsc = rdtsc() - start_tsc;
+  // Picoseconds per cycle keeps the conversion in integers.
+  uint64_t ps_per_cycle =
+      elapsed_tsc ? (uint64_t)((unsigned __int128)elapsed_ns * 1000 /
+                               elapsed_tsc)
+                  : 0;
+#define CYCLES_NS(c) ((uint64_t)((unsigned __int128)(c) * ps_per_cycle / 1000))
+
+  gui_out *err = gui_stderr;
+  gui_out_flush(gui_stdout);
+  gui_out_str(err, "\nsyscall             calls   errors        bytes"
+                   "    total_us   avg_ns   p50_ns   p99_ns\n");
+
+  uint64_t hist[SYSSTATS_BUCKETS] = {0};
+  uint64_t calls = 0, cycles = 0;
+  for (int64_t num = 0; num < SYSSTATS_SLOTS; ++num) {
+    SysStat *s = &snap[num];
+    if (s->calls == 0) {
+      continue;
+    }
+    calls += s->calls;
+    cycles += s->cycles;
+    for (unsigned k = 0; k < SYSSTATS_BUCKETS; ++k) {
+      hist[k] += s->hist[k];
+    }
+    put_name(err, num);
+    put_num(err, s->calls, 9);
+    put_num(err, s->errors, 9);
+    put_num(err, s->bytes, 13);
+    put_num(err, CYCLES_NS(s->cycles) / 1000, 12);
+    put_num(err, CYCLES_NS(s->cycles / s->calls), 9);
+    put_num(err, CYCLES_NS(quantile(s->hist, s->calls, 500)), 9);
+    put_num(err, CYCLES_NS(quantile(s->hist, s->calls, 990)), 9);
+    gui_out_char(err, '\n');
+  }
+
+  gui_out_str(err, "total           ");
+  put_num(err, calls, 9);
+  gui_out_str(err, " syscalls, ");
+  gui_out_unum(err, CYCLES_NS(cycles) / 1000);
+  gui_out_str(err, " us in the kernel, ");
+  gui_out_unum(err, elapsed_ns / 1000);
+  gui_out_str(err, " us elapsed\n\nlatency (ns)       calls\n");
+
+  for (unsigned k = 0; k < SYSSTATS_BUCKETS; ++k) {
+    if (hist[k] == 0) {
+      continue;
+    }
+    char range[GUI_FMT_MAX * 2 + 4];
+    size_t len = 0;
+    range[len++] = '<';
+    range[len++] = ' ';
+    len += gui_fmt_u64(range + len, CYCLES_NS((uint64_t)2 << k));
+    put_field(err, range, len, 12);
+    put_num(err, hist[k], 12);
+    gui_out_str(err, "  ");
+    // One '#' per 2% of all calls, at least one for a non-empty bucket.
+    for (uint64_t bar = hist[k] * 50 / calls + 1; bar > 0; --bar) {
+      gui_out_char(err, '#');
+    }
+    gui_out_char(err, '\n');
+  }
+#undef CYCLES_NS
+}
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * @file uring.c
+ * @brief io_uring setup, teardown, submission and registration (see uring.h).
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/mman.h>
+#include <stdint.h>
+#include "guicall.h"
+#include "sysnums.h"
+#include "uring.h"
+
+static void *ring_map(int fd, size_t size, uint64_t offset) {
+  int64_t mem = guicall(SYS_mmap, NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, offset);
+  return mem < 0 ? NULL : (void *)mem;
+}
+
+#define PROBE_OPS 256
+
+/**
+ * @brief Fills ring->ops with the opcodes the kernel reports. Kernels
+ * without IORING_REGISTER_PROBE (before 5.6) leave it empty, so callers
+ * fall back to plain syscalls for everything.
+ */
+
+static void ring_probe(gui_uring *ring) {
+  union {
+    struct io_uring_probe probe;
+    char bytes[sizeof(struct io_uring_probe) +
+               PROBE_OPS * sizeof(struct io_uring_probe_op)];
+  } buf;
+  __builtin_memset(&buf, 0, sizeof(buf));
+  if (guicall(SYS_io_uring_register, ring->fd, IORING_REGISTER_PROBE,
+              &buf.probe, PROBE_OPS) < 0) {
+    return;
+  }
+  for (unsigned i = 0; i < buf.probe.ops_len && i < PROBE_OPS; ++i) {
+    const struct io_uring_probe_op *op = &buf.probe.ops[i];
+    if (op->flags & IO_URING_OP_SUPPORTED) {
+      ring->ops[op->op >> 3] |= (unsigned char)(1u << (op->op & 7));
+    }
+  }
+}
+
+/**
+ * @brief Creates a ring with room for 'entries' submissions and maps its
+ * queues.
+ * @return 0 on success, or a negative errno: -ENOSYS on kernels without
+ * io_uring, -EPERM when it is disabled by kernel.io_uring_disabled or a
+ * seccomp filter.
+ */
+
+int gui_uring_init(gui_uring *ring, unsigned entries) {
+  struct io_uring_params params;
+  __builtin_memset(&params, 0, sizeof(params));
+  __builtin_memset(ring, 0, sizeof(*ring));
+
+  int fd = guicall(SYS_io_uring_setup, entries, &params);
+  if (fd < 0) {
+    ring->fd = -1;
+    return fd;
+  }
+  ring->fd = fd;
+
+  ring->sq_ring_size =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_ring_size > ring->sq_ring_size) {
+      ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->cq_ring_size = ring->sq_ring_size;
+  }
+
+  ring->sq_ring = ring_map(fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == NULL) {
+    gui_uring_exit(ring);
+    return -ENOMEM;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->cq_ring = ring_map(fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    if (ring->cq_ring == NULL) {
+      gui_uring_exit(ring);
+      return -ENOMEM;
+    }
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = ring_map(fd, ring->sqes_size, IORING_OFF_SQES);
+  if (ring->sqes == NULL) {
+    gui_uring_exit(ring);
+    return -ENOMEM;
+  }
+
+  char *sq = (char *)ring->sq_ring;
+  char *cq = (char *)ring->cq_ring;
+  ring->sq_entries = params.sq_entries;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  ring->sqe_tail = *ring->sq_tail;
+  ring_probe(ring);
+  return 0;
+}
+
+void gui_uring_exit(gui_uring *ring) {
+  if (ring->sqes != NULL) {
+    guicall(SYS_munmap, ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) {
+    guicall(SYS_munmap, ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring != NULL) {
+    guicall(SYS_munmap, ring->sq_ring, ring->sq_ring_size);
+  }
+  if (ring->fd >= 0) {
+    guicall(SYS_close, ring->fd);
+  }
+  __builtin_memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+/**
+ * @brief Hands out the next free submission slot.
+ * @return The SQE to fill in, or NULL when the submission queue is full and
+ * has to be submitted first.
+ */
+
+struct io_uring_sqe *gui_uring_get_sqe(gui_uring *ring) {
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (ring->sqe_tail - head >= ring->sq_entries) {
+    return NULL;
+  }
+  unsigned index = ring->sqe_tail & *ring->sq_mask;
+  ring->sq_array[index] = index;
+  ring->sqe_tail++;
+  return &ring->sqes[index];
+}
+
+/**
+ * @brief Publishes every SQE handed out since the last call and, when
+ * 'wait_nr' > 0, blocks until at least that many completions are ready.
+ * @return The number of SQEs the kernel consumed, or a negative errno.
+ */
+
+int gui_uring_submit(gui_uring *ring, unsigned wait_nr) {
+  __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+  unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+  for (;;) {
+    // Recomputed on every pass: an interrupted wait may already have
+    // consumed the SQEs.
+    unsigned to_submit =
+        ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    int64_t ret = guicall(SYS_io_uring_enter, ring->fd, to_submit, wait_nr,
+                          flags, NULL, 0);
+    if (ret != -EINTR) {
+      return (int)ret;
+    }
+  }
+}
+
+/**
+ * @brief Takes back the SQEs handed out but not yet consumed by the kernel,
+ * e.g. after gui_uring_submit() failed. The ring has no SQPOLL thread, so
+ * nothing consumes them outside io_uring_enter.
+ * @return How many were taken back; they will never complete.
+ */
+
+unsigned gui_uring_discard_sqes(gui_uring *ring) {
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  unsigned count = ring->sqe_tail - head;
+  ring->sqe_tail = head;
+  __atomic_store_n(ring->sq_tail, head, __ATOMIC_RELEASE);
+  return count;
+}
+
+/**
+ * @brief Returns the oldest completion, submitting what is pending and
+ * blocking until one arrives when the queue is empty.
+ * @return The CQE (release it with gui_uring_cqe_seen()), or NULL when
+ * io_uring_enter failed.
+ */
+
+struct io_uring_cqe *gui_uring_wait_cqe(gui_uring *ring) {
+  struct io_uring_cqe *cqe;
+  while ((cqe = gui_uring_peek_cqe(ring)) == NULL) {
+    if (gui_uring_submit(ring, 1) < 0) {
+      return NULL;
+    }
+  }
+  return cqe;
+}
+
+/**
+ * @brief Stores up to 'max' ready completions, oldest first, without
+ * waiting. Release them together with gui_uring_cq_advance().
+ * @return The number stored.
+ */
+
+unsigned gui_uring_peek_batch(gui_uring *ring, struct io_uring_cqe **cqes,
+                              unsigned max) {
+  unsigned head = *ring->cq_head;
+  unsigned ready = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - head;
+  unsigned count = ready < max ? ready : max;
+  for (unsigned i = 0; i < count; ++i) {
+    cqes[i] = &ring->cqes[(head + i) & *ring->cq_mask];
+  }
+  return count;
+}
+
+/*
+ * ==============
+ * =Registration=
+ * ==============
+ *
+ * Each call is one io_uring_register and returns 0 or a negative errno.
+ * A ring holds one set of buffers and one set of files at a time; register
+ * again only after unregistering.
+ */
+
+static int ring_register(gui_uring *ring, unsigned opcode, const void *arg,
+                         unsigned count) {
+  for (;;) {
+    int64_t ret =
+        guicall(SYS_io_uring_register, ring->fd, opcode, arg, count);
+    if (ret != -EINTR) {
+      return ret < 0 ? (int)ret : 0;
+    }
+  }
+}
+
+/**
+ * @brief Pins 'count' buffers for gui_uring_prep_read_fixed() and
+ * gui_uring_prep_write_fixed(), which refer to them by index. The memory
+ * counts against RLIMIT_MEMLOCK on kernels before 5.12.
+ */
+
+int gui_uring_register_buffers(gui_uring *ring, const gui_uring_buf *bufs,
+                               unsigned count) {
+  return ring_register(ring, IORING_REGISTER_BUFFERS, bufs, count);
+}
+
+int gui_uring_unregister_buffers(gui_uring *ring) {
+  return ring_register(ring, IORING_UNREGISTER_BUFFERS, NULL, 0);
+}
+
+/**
+ * @brief Registers 'count' fds for gui_uring_fixed_file(). An fd of -1
+ * leaves its slot empty. The ring keeps its own reference, so the caller
+ * may close the fds afterwards.
+ */
+
+int gui_uring_register_files(gui_uring *ring, const int *fds,
+                             unsigned count) {
+  return ring_register(ring, IORING_REGISTER_FILES, fds, count);
+}
+
+int gui_uring_unregister_files(gui_uring *ring) {
+  return ring_register(ring, IORING_UNREGISTER_FILES, NULL, 0);
+}
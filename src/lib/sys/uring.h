@@ -0,0 +1,242 @@
+#ifndef SYS_URING_H
+#define SYS_URING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Minimal io_uring driver on top of the raw SYS_io_uring_* syscalls.
+ *
+ *   struct io_uring_sqe *sqe = gui_uring_get_sqe(&ring);
+ *   gui_uring_prep_statx(sqe, dirfd, name, flags, mask, &stx, index);
+ *   gui_uring_submit(&ring, 1);            // submit, wait for >= 1 CQE
+ *   while ((cqe = gui_uring_peek_cqe(&ring)) != NULL) {
+ *     ... cqe->user_data, cqe->res ...
+ *     gui_uring_cqe_seen(&ring);
+ *   }
+ *
+ * Submissions can be batched: fill in as many SQEs as the queue holds (up
+ * to the 'entries' given to gui_uring_init), then one gui_uring_submit()
+ * hands them all to the kernel, and waits for completions, in a single
+ * io_uring_enter. gui_uring_peek_batch() and gui_uring_cq_advance() reap
+ * completions in bulk.
+ *
+ * gui_uring_init() probes which opcodes the running kernel supports; check
+ * gui_uring_supported() before relying on one and fall back to the plain
+ * syscall when it says no. Kernels before 5.6 cannot be probed and report
+ * nothing as supported.
+ *
+ * Buffers and files can be registered once (gui_uring_register_buffers,
+ * gui_uring_register_files) so the kernel does not look them up for every
+ * request: gui_uring_prep_read_fixed()/write_fixed() take a buffer index,
+ * gui_uring_fixed_file() turns an SQE's fd into an index into the files.
+ *
+ * A ring belongs to one thread; nothing here is safe to share.
+ */
+
+// A registered buffer; the layout of struct iovec.
+typedef struct gui_uring_buf {
+  void *base;
+  size_t len;
+} gui_uring_buf;
+
+typedef struct gui_uring {
+  int fd;
+  unsigned sq_entries;
+  unsigned sqe_tail; // Local tail: SQEs handed out but not yet submitted.
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring; // Same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP.
+  size_t cq_ring_size;
+  size_t sqes_size;
+  unsigned char ops[32]; // Bitmap of the opcodes the kernel supports.
+} gui_uring;
+
+int gui_uring_init(gui_uring *ring, unsigned entries);
+void gui_uring_exit(gui_uring *ring);
+struct io_uring_sqe *gui_uring_get_sqe(gui_uring *ring);
+int gui_uring_submit(gui_uring *ring, unsigned wait_nr);
+unsigned gui_uring_discard_sqes(gui_uring *ring);
+struct io_uring_cqe *gui_uring_wait_cqe(gui_uring *ring);
+unsigned gui_uring_peek_batch(gui_uring *ring, struct io_uring_cqe **cqes,
+                              unsigned max);
+
+int gui_uring_register_buffers(gui_uring *ring, const gui_uring_buf *bufs,
+                               unsigned count);
+int gui_uring_unregister_buffers(gui_uring *ring);
+int gui_uring_register_files(gui_uring *ring, const int *fds,
+                             unsigned count);
+int gui_uring_unregister_files(gui_uring *ring);
+
+/**
+ * @brief Whether the kernel reported opcode 'op' as supported when the ring
+ * was set up.
+ */
+
+static inline int gui_uring_supported(const gui_uring *ring, unsigned op) {
+  return op < 256 && (ring->ops[op >> 3] >> (op & 7)) & 1;
+}
+
+/**
+ * @brief Submission slots still free.
+ */
+
+static inline unsigned gui_uring_sq_space(gui_uring *ring) {
+  return ring->sq_entries -
+         (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief Returns the oldest unconsumed completion, or NULL when the
+ * completion queue is empty. Release it with gui_uring_cqe_seen().
+ */
+
+static inline struct io_uring_cqe *gui_uring_peek_cqe(gui_uring *ring) {
+  unsigned head = *ring->cq_head;
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &ring->cqes[head & *ring->cq_mask];
+}
+
+static inline void gui_uring_cqe_seen(gui_uring *ring) {
+  __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Releases the 'count' oldest completions at once, e.g. after
+ * gui_uring_peek_batch().
+ */
+
+static inline void gui_uring_cq_advance(gui_uring *ring, unsigned count) {
+  __atomic_store_n(ring->cq_head, *ring->cq_head + count, __ATOMIC_RELEASE);
+}
+
+/*
+ * =====================
+ * =Submission helpers=
+ * =====================
+ *
+ * Each one clears the SQE and fills it in for one operation. The result
+ * arrives in cqe->res: what the plain syscall would return, -errno on
+ * failure. 'off' of (uint64_t)-1 means the current file position.
+ */
+
+static inline void gui_uring_prep_rw(struct io_uring_sqe *sqe, unsigned op,
+                                     int fd, const void *addr, unsigned len,
+                                     uint64_t off, uint64_t user_data) {
+  __builtin_memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = (uint8_t)op;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)addr;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->user_data = user_data;
+}
+
+static inline void gui_uring_prep_statx(struct io_uring_sqe *sqe, int dirfd,
+                                        const char *path, int flags,
+                                        unsigned mask, void *statxbuf,
+                                        uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_STATX, dirfd, path, mask,
+                    (uint64_t)(uintptr_t)statxbuf, user_data);
+  sqe->statx_flags = (uint32_t)flags;
+}
+
+static inline void gui_uring_prep_read(struct io_uring_sqe *sqe, int fd,
+                                       void *buf, unsigned len, uint64_t off,
+                                       uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_READ, fd, buf, len, off, user_data);
+}
+
+static inline void gui_uring_prep_write(struct io_uring_sqe *sqe, int fd,
+                                        const void *buf, unsigned len,
+                                        uint64_t off, uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_WRITE, fd, buf, len, off, user_data);
+}
+
+/**
+ * @brief Reads into registered buffer 'buf_index'; 'buf' must lie inside it.
+ */
+
+static inline void gui_uring_prep_read_fixed(struct io_uring_sqe *sqe, int fd,
+                                             void *buf, unsigned len,
+                                             uint64_t off, unsigned buf_index,
+                                             uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_READ_FIXED, fd, buf, len, off, user_data);
+  sqe->buf_index = (uint16_t)buf_index;
+}
+
+static inline void gui_uring_prep_write_fixed(struct io_uring_sqe *sqe,
+                                              int fd, const void *buf,
+                                              unsigned len, uint64_t off,
+                                              unsigned buf_index,
+                                              uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_WRITE_FIXED, fd, buf, len, off,
+                    user_data);
+  sqe->buf_index = (uint16_t)buf_index;
+}
+
+static inline void gui_uring_prep_openat(struct io_uring_sqe *sqe, int dirfd,
+                                         const char *path, int flags,
+                                         unsigned mode, uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_OPENAT, dirfd, path, mode, 0, user_data);
+  sqe->open_flags = (uint32_t)flags;
+}
+
+static inline void gui_uring_prep_close(struct io_uring_sqe *sqe, int fd,
+                                        uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_CLOSE, fd, NULL, 0, 0, user_data);
+}
+
+/**
+ * @brief Moves up to 'len' bytes from 'fd_in' to 'fd_out', one of which
+ * must be a pipe. Offsets of (uint64_t)-1 use the file positions.
+ */
+
+static inline void gui_uring_prep_splice(struct io_uring_sqe *sqe, int fd_in,
+                                         uint64_t off_in, int fd_out,
+                                         uint64_t off_out, unsigned len,
+                                         unsigned flags, uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_SPLICE, fd_out, NULL, len, off_out,
+                    user_data);
+  sqe->splice_off_in = off_in;
+  sqe->splice_fd_in = fd_in;
+  sqe->splice_flags = flags;
+}
+
+static inline void gui_uring_prep_unlinkat(struct io_uring_sqe *sqe,
+                                           int dirfd, const char *path,
+                                           int flags, uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_UNLINKAT, dirfd, path, 0, 0, user_data);
+  sqe->unlink_flags = (uint32_t)flags;
+}
+
+static inline void gui_uring_prep_mkdirat(struct io_uring_sqe *sqe, int dirfd,
+                                          const char *path, unsigned mode,
+                                          uint64_t user_data) {
+  gui_uring_prep_rw(sqe, IORING_OP_MKDIRAT, dirfd, path, mode, 0, user_data);
+}
+
+/**
+ * @brief Makes a prepared SQE refer to registered file 'index' instead of
+ * the fd it was given. For splice, only the output side is switched.
+ */
+
+static inline void gui_uring_fixed_file(struct io_uring_sqe *sqe,
+                                        unsigned index) {
+  sqe->fd = (int32_t)index;
+  sqe->flags |= IOSQE_FIXED_FILE;
+}
+
+#endif // SYS_URING_H
@@ -0,0 +1,236 @@
+/*
+ * @file thread.c
+ * @brief clone/futex based threads, a futex mutex and a condition variable.
+ *
+ * Each thread runs on its own mmap'd stack with a PROT_NONE guard page at
+ * the bottom, so an overflow faults instead of silently corrupting the
+ * neighbouring mapping. Threads are created with clone3, which takes the
+ * stack as a (base, size) pair; kernels before 5.3 (or seccomp profiles
+ * that refuse clone3) get the classic clone instead.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <linux/mman.h>
+#include <linux/sched.h>
+#include <stdint.h>
+#include "atomic.h"
+#include "lib.h"
+#include "sys/guicall.h"
+#include "sys/sysnums.h"
+#include "thread.h"
+
+/*
+ * The same 8 MiB a main thread gets by default (RLIMIT_STACK). The mapping
+ * is MAP_NORESERVE, so only the pages a thread touches cost memory.
+ *
+ * Worst case per directory for a mini-ls worker: the name sort takes one
+ * ~6 KiB frame per halving of the entry count past 32 (about 100 KiB at
+ * a million entries), and formatting an entry adds under 10 KiB
+ * (readlink target, number buffers). Directories are taken from a queue,
+ * not recursed into, so tree depth adds nothing. Measured peaks are
+ * around 20 KiB, for a 200k-entry directory.
+ */
+#define THREAD_STACK_SIZE (8 * 1024 * 1024)
+#define THREAD_GUARD_SIZE 4096
+
+#define THREAD_CLONE_FLAGS                                                     \
+  (CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD |          \
+   CLONE_SYSVSEM | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID)
+
+/**
+ * @brief First C code a new thread runs; never returns.
+ */
+
+static void thread_entry(gui_thread *thread) {
+  thread->ret = thread->fn(thread->arg);
+  // SYS_exit ends only this thread; the kernel then clears 'tid' and wakes
+  // gui_thread_join().
+  for (;;) {
+    guicall(SYS_exit, 0);
+  }
+}
+
+// What the child runs right after the syscall: it starts on a stack
+// holding the thread pointer and the entry function, pops both and calls
+// the entry. The parent (rax != 0) jumps past it.
+#define CHILD_START                                                            \
+  "test %%rax, %%rax\n\t"                                                      \
+  "jnz 1f\n\t"                                                                 \
+  "xor %%ebp, %%ebp\n\t"                                                       \
+  "pop %%rdi\n\t"                                                              \
+  "pop %%rax\n\t"                                                              \
+  "call *%%rax\n\t"                                                            \
+  "hlt\n\t"                                                                    \
+  "1:\n\t"
+
+static int have_clone3 = 1;
+
+static void **child_stack(gui_thread *thread, char *stack_top) {
+  void **sp = (void **)stack_top - 2;
+  sp[0] = thread;
+  sp[1] = (void *)thread_entry;
+  return sp;
+}
+
+/**
+ * @brief Raw clone3(2); the child's stack pointer is base + size.
+ */
+
+static int64_t clone3_thread(gui_thread *thread, char *stack_top) {
+  void **sp = child_stack(thread, stack_top);
+  struct clone_args args;
+  __builtin_memset(&args, 0, sizeof(args));
+  args.flags = THREAD_CLONE_FLAGS;
+  args.child_tid = (uint64_t)(uintptr_t)&thread->tid;
+  args.parent_tid = (uint64_t)(uintptr_t)&thread->tid;
+  args.stack = (uint64_t)(uintptr_t)thread->stack;
+  args.stack_size = (uint64_t)((char *)sp - (char *)thread->stack);
+
+  int64_t ret;
+  __asm__ volatile("syscall\n\t" CHILD_START
+                   : "=a"(ret)
+                   : "a"(SYS_clone3), "D"(&args), "S"(sizeof(args))
+                   : "rcx", "r11", "memory");
+  return ret;
+}
+
+/**
+ * @brief Raw clone(2), for kernels without clone3.
+ */
+
+static int64_t clone_thread(gui_thread *thread, char *stack_top) {
+  void **sp = child_stack(thread, stack_top);
+
+  int64_t ret;
+  register int64_t r10 asm("r10") = (int64_t)&thread->tid; // child_tid
+  register int64_t r8 asm("r8") = 0;                       // tls
+  __asm__ volatile("syscall\n\t" CHILD_START
+                   : "=a"(ret)
+                   : "a"(SYS_clone), "D"(THREAD_CLONE_FLAGS), "S"(sp),
+                     "d"(&thread->tid), "r"(r10), "r"(r8)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
+
+/**
+ * @brief Starts 'fn(arg)' on a new thread.
+ * @return 0 on success or a negative errno.
+ */
+
+int gui_thread_spawn(gui_thread *thread, gui_thread_fn fn, void *arg) {
+  size_t size = THREAD_STACK_SIZE + THREAD_GUARD_SIZE;
+  int64_t stack = guicall(SYS_mmap, NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK |
+                              MAP_NORESERVE,
+                          -1, 0);
+  if (stack < 0) {
+    return (int)stack;
+  }
+  guicall(SYS_mprotect, stack, THREAD_GUARD_SIZE, PROT_NONE);
+
+  thread->fn = fn;
+  thread->arg = arg;
+  thread->ret = 0;
+  thread->stack = (void *)stack;
+  thread->stack_size = size;
+
+  int64_t tid = -ENOSYS;
+  if (gui_atomic_load(&have_clone3)) {
+    tid = clone3_thread(thread, (char *)stack + size);
+    if (tid == -ENOSYS || tid == -EPERM) {
+      gui_atomic_store(&have_clone3, 0);
+    }
+  }
+  if (!gui_atomic_load(&have_clone3)) {
+    tid = clone_thread(thread, (char *)stack + size);
+  }
+  if (tid < 0) {
+    guicall(SYS_munmap, stack, size);
+    return (int)tid;
+  }
+  return 0;
+}
+
+/**
+ * @brief Waits for 'thread' to exit, releases its stack and returns the
+ * value its function returned.
+ */
+
+int gui_thread_join(gui_thread *thread) {
+  int tid;
+  // CLONE_CHILD_CLEARTID wakes through a shared futex, so no private flag.
+  while ((tid = __atomic_load_n(&thread->tid, __ATOMIC_ACQUIRE)) != 0) {
+    guicall(SYS_futex, &thread->tid, FUTEX_WAIT, tid, NULL);
+  }
+  guicall(SYS_munmap, thread->stack, thread->stack_size);
+  thread->stack = NULL;
+  return thread->ret;
+}
+
+/**
+ * @brief Sleeps while '*addr' == 'val' (or until woken / interrupted).
+ */
+
+int gui_futex_wait(int *addr, int val) {
+  return (int)guicall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL);
+}
+
+/**
+ * @brief Wakes up to 'count' threads sleeping on 'addr'.
+ */
+
+int gui_futex_wake(int *addr, int count) {
+  return (int)guicall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count);
+}
+
+void gui_mutex_lock(gui_mutex *mutex) {
+  int c = 0;
+  if (__atomic_compare_exchange_n(&mutex->state, &c, 1, 0, __ATOMIC_ACQUIRE,
+                                  __ATOMIC_RELAXED)) {
+    return;
+  }
+  if (c != 2) {
+    c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+  }
+  while (c != 0) {
+    gui_futex_wait(&mutex->state, 2);
+    c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void gui_mutex_unlock(gui_mutex *mutex) {
+  if (__atomic_fetch_sub(&mutex->state, 1, __ATOMIC_RELEASE) != 1) {
+    __atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+    gui_futex_wake(&mutex->state, 1);
+  }
+}
+
+/*
+ * Condition variable: a sequence number bumped by every signal. A waiter
+ * reads it while still holding the mutex, so a signal sent after it
+ * unlocks changes the value and the futex wait returns at once instead of
+ * missing the wakeup. Wakeups may be spurious; wait in a loop on the
+ * predicate.
+ */
+
+void gui_cond_wait(gui_cond *cond, gui_mutex *mutex) {
+  int seq = gui_atomic_load_acquire(&cond->seq);
+  gui_mutex_unlock(mutex);
+  gui_futex_wait(&cond->seq, seq);
+  gui_mutex_lock(mutex);
+}
+
+void gui_cond_signal(gui_cond *cond) {
+  gui_atomic_add_acq_rel(&cond->seq, 1);
+  gui_futex_wake(&cond->seq, 1);
+}
+
+void gui_cond_broadcast(gui_cond *cond) {
+  gui_atomic_add_acq_rel(&cond->seq, 1);
+  gui_futex_wake(&cond->seq, INT32_MAX);
+}
@@ -0,0 +1,65 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stddef.h>
+
+/*
+ * Minimal threads on top of SYS_clone and SYS_futex.
+ *
+ * Threads share the address space, files and signal handlers of the process
+ * but get no TLS of their own, so code running on them must stay inside this
+ * library (no libc calls).
+ */
+
+typedef int (*gui_thread_fn)(void *arg);
+
+typedef struct gui_thread {
+  int tid; // Cleared (and futex-woken) by the kernel when the thread exits.
+  int ret;
+  gui_thread_fn fn;
+  void *arg;
+  void *stack;
+  size_t stack_size;
+} gui_thread;
+
+int gui_thread_spawn(gui_thread *thread, gui_thread_fn fn, void *arg);
+int gui_thread_join(gui_thread *thread);
+
+int gui_futex_wait(int *addr, int val);
+int gui_futex_wake(int *addr, int count);
+
+/*
+ * Three-state futex mutex: 0 unlocked, 1 locked, 2 locked with waiters.
+ * Uncontended lock/unlock never enter the kernel.
+ */
+
+typedef struct gui_mutex {
+  int state;
+} gui_mutex;
+
+#define GUI_MUTEX_INIT {0}
+
+void gui_mutex_lock(gui_mutex *mutex);
+void gui_mutex_unlock(gui_mutex *mutex);
+
+/*
+ * Condition variable for use with a gui_mutex:
+ *
+ *   gui_mutex_lock(&m);
+ *   while (!ready) {
+ *     gui_cond_wait(&c, &m);
+ *   }
+ *   gui_mutex_unlock(&m);
+ */
+
+typedef struct gui_cond {
+  int seq;
+} gui_cond;
+
+#define GUI_COND_INIT {0}
+
+void gui_cond_wait(gui_cond *cond, gui_mutex *mutex);
+void gui_cond_signal(gui_cond *cond);
+void gui_cond_broadcast(gui_cond *cond);
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * @file workers.c
+ * @brief Fixed-size worker pool (see workers.h).
+ *
+ * Idle workers sleep on the 'wake' futex. A worker bumps 'idle' before it
+ * sleeps and a submitter bumps 'wake' before it checks 'idle', both
+ * sequentially consistent: either the submitter sees the sleeper and wakes
+ * it, or the sleeper's futex wait sees the new 'wake' value and returns.
+ * Submitting to a busy pool therefore costs no syscall.
+ *
+ * @license MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include "atomic.h"
+#include "workers.h"
+
+/**
+ * @brief Runs 'task' and accounts for it; the last task to finish wakes
+ * gui_workers_wait().
+ */
+
+static void run_task(gui_workers *pool, gui_task *task) {
+  task->run(task);
+  if (gui_atomic_sub_acq_rel(&pool->pending, 1) == 0) {
+    gui_futex_wake(&pool->pending, INT32_MAX);
+  }
+}
+
+static int worker_main(void *arg) {
+  gui_workers *pool = arg;
+  for (;;) {
+    gui_task *task = gui_mpmc_pop(&pool->queue);
+    if (task != NULL) {
+      run_task(pool, task);
+      continue;
+    }
+
+    int wake = gui_atomic_load_acquire(&pool->wake);
+    if (gui_atomic_load_acquire(&pool->stop)) {
+      return 0;
+    }
+    // A task pushed before 'wake' was read is caught here; one pushed
+    // after it changes 'wake' and the futex wait falls through.
+    task = gui_mpmc_pop(&pool->queue);
+    if (task != NULL) {
+      run_task(pool, task);
+      continue;
+    }
+    gui_atomic_add_seq_cst(&pool->idle, 1);
+    gui_futex_wait(&pool->wake, wake);
+    gui_atomic_sub(&pool->idle, 1);
+  }
+}
+
+/**
+ * @brief Starts 'count' workers (at most GUI_WORKERS_MAX) sharing a queue
+ * of 'queue_size' tasks.
+ * @return 0, or a negative errno; nothing is left running on failure.
+ */
+
+int gui_workers_start(gui_workers *pool, int count, size_t queue_size) {
+  if (count < 1) {
+    count = 1;
+  } else if (count > GUI_WORKERS_MAX) {
+    count = GUI_WORKERS_MAX;
+  }
+  pool->count = 0;
+  pool->stop = 0;
+  pool->wake = 0;
+  pool->idle = 0;
+  pool->pending = 0;
+  int ret = gui_mpmc_init(&pool->queue, queue_size);
+  if (ret < 0) {
+    return ret;
+  }
+  for (int i = 0; i < count; ++i) {
+    ret = gui_thread_spawn(&pool->threads[i], worker_main, pool);
+    if (ret < 0) {
+      gui_workers_stop(pool);
+      return ret;
+    }
+    pool->count = i + 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Queues 'task'. When the queue is full the caller runs it itself,
+ * which also throttles a producer that outpaces the workers.
+ */
+
+void gui_workers_submit(gui_workers *pool, gui_task *task) {
+  gui_atomic_add(&pool->pending, 1);
+  if (gui_mpmc_push(&pool->queue, task) < 0) {
+    run_task(pool, task);
+    return;
+  }
+  gui_atomic_add_seq_cst(&pool->wake, 1);
+  if (gui_atomic_load_seq_cst(&pool->idle) > 0) {
+    gui_futex_wake(&pool->wake, 1);
+  }
+}
+
+/**
+ * @brief Returns once every submitted task has finished, running queued
+ * tasks on the calling thread meanwhile.
+ */
+
+void gui_workers_wait(gui_workers *pool) {
+  gui_task *task;
+  while ((task = gui_mpmc_pop(&pool->queue)) != NULL) {
+    run_task(pool, task);
+  }
+  int pending;
+  while ((pending = gui_atomic_load_acquire(&pool->pending)) != 0) {
+    gui_futex_wait(&pool->pending, pending);
+  }
+}
+
+/**
+ * @brief Finishes the queued tasks, then stops and joins the workers.
+ */
+
+void gui_workers_stop(gui_workers *pool) {
+  gui_workers_wait(pool);
+  gui_atomic_store_release(&pool->stop, 1);
+  gui_atomic_add_seq_cst(&pool->wake, 1);
+  gui_futex_wake(&pool->wake, INT32_MAX);
+  for (int i = 0; i < pool->count; ++i) {
+    gui_thread_join(&pool->threads[i]);
+  }
+  pool->count = 0;
+  gui_mpmc_destroy(&pool->queue);
+}
@@ -0,0 +1,49 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "mpmc.h"
+#include "thread.h"
+
+/*
+ * Fixed-size pool of worker threads fed by a gui_mpmc queue.
+ *
+ * Tasks are intrusive: embed a gui_task in your own structure, set 'run',
+ * and recover the structure from the pointer in the callback. Nothing is
+ * allocated per task.
+ *
+ *   typedef struct { gui_task task; const char *path; } HashJob;
+ *   static void hash_run(gui_task *t) { HashJob *job = (HashJob *)t; ... }
+ *
+ *   gui_workers pool;
+ *   gui_workers_start(&pool, 8, 1024);
+ *   job->task.run = hash_run;
+ *   gui_workers_submit(&pool, &job->task);
+ *   gui_workers_wait(&pool);   // every submitted task has run
+ *   gui_workers_stop(&pool);
+ *
+ * Tasks run on threads without TLS (see thread.h): no libc in 'run'.
+ * Submitting and waiting belong to one thread; tasks may submit too.
+ */
+
+typedef struct gui_task {
+  void (*run)(struct gui_task *task);
+} gui_task;
+
+#define GUI_WORKERS_MAX 256
+
+typedef struct gui_workers {
+  gui_mpmc queue;
+  int count;
+  int stop;
+  int wake;    // Futex: bumped by every submit; idle workers sleep on it.
+  int idle;    // Workers asleep or about to be.
+  int pending; // Futex: submitted tasks not finished yet.
+  gui_thread threads[GUI_WORKERS_MAX];
+} gui_workers;
+
+int gui_workers_start(gui_workers *pool, int count, size_t queue_size);
+void gui_workers_submit(gui_workers *pool, gui_task *task);
+void gui_workers_wait(gui_workers *pool);
+void gui_workers_stop(gui_workers *pool);
+
+#endif
@@ -1,58 +1,197 @@
 #define _GNU_SOURCE
 
 #include "lib.h"
+#include <errno.h>
 #include <linux/fcntl.h>
+#include <stdint.h>
+#include "out.h"
 #include "sys/guicall.h"
 #include "sys/sysnums.h"
 
-void error(const char *msg) {
-  guicall(SYS_write, STDERR_FILENO, (int64_t)msg, guilen(msg));
+#define S_IFMT_MASK 0170000
+#define S_IFREG_BITS 0100000
+#define S_IFIFO_BITS 0010000
+#define S_IFSOCK_BITS 0140000
+
+#define SPLICE_F_MOVE 1
+#define SPLICE_F_MORE 4
+
+// Upper bound per zero-copy call; the kernel clamps it further (sendfile
+// caps at 0x7ffff000, splice at the pipe capacity).
+#define ZC_CHUNK (1024L * 1024 * 1024)
+
+struct stat64 {
+  uint64_t st_dev;
+  uint64_t st_ino;
+  uint64_t st_nlink;
+  uint32_t st_mode;
+  uint32_t st_uid;
+  uint32_t st_gid;
+  uint32_t __pad0;
+  uint64_t st_rdev;
+  int64_t st_size;
+  int64_t st_blksize;
+  int64_t st_blocks;
+  uint64_t st_atime;
+  uint64_t st_atime_nsec;
+  uint64_t st_mtime;
+  uint64_t st_mtime_nsec;
+  uint64_t st_ctime;
+  uint64_t st_ctime_nsec;
+  int64_t __unused[3];
+};
+
+enum copy_method { COPY_RW, COPY_FILE_RANGE, COPY_SPLICE, COPY_SENDFILE };
+
+void error(const char *msg) { gui_out_str(gui_stderr, msg); }
+
+/**
+ * @brief Picks the kernel-side copy primitive for an (in, out) fd pair.
+ *
+ * copy_file_range and sendfile are only tried when the input is a regular
+ * file with a non-zero size: procfs and friends report st_size == 0 and some
+ * kernels silently copy nothing from them.
+ */
+
+static enum copy_method pick_method(int in_fd) {
+  struct stat64 in_st, out_st;
+  if (guicall(SYS_fstat, in_fd, &in_st) < 0 ||
+      guicall(SYS_fstat, STDOUT_FILENO, &out_st) < 0) {
+    return COPY_RW;
+  }
+
+  uint32_t in_type = in_st.st_mode & S_IFMT_MASK;
+  uint32_t out_type = out_st.st_mode & S_IFMT_MASK;
+  int in_sized_file = in_type == S_IFREG_BITS && in_st.st_size > 0;
+
+  if (out_type == S_IFREG_BITS && in_sized_file) {
+    return COPY_FILE_RANGE;
+  }
+  if (in_type == S_IFIFO_BITS || out_type == S_IFIFO_BITS) {
+    return COPY_SPLICE;
+  }
+  if (out_type == S_IFSOCK_BITS && in_sized_file) {
+    return COPY_SENDFILE;
+  }
+  return COPY_RW;
 }
 
-void cat(const char *pathname) {
-  char buffer[(1024 * 8)];
-  int fd = guicall(SYS_open, (int64_t)pathname, O_RDONLY);
-  if (fd < 0) {
-    error("Mini-cat: ");
-    error(pathname);
-    error(": No such file or directory.\n");
-    guicall(SYS_exit, 1, 0, 0, 0, 0, 0);
+/**
+ * @brief Moves data from 'in_fd' to stdout without bouncing it through user
+ * space.
+ *
+ * @return 0 when the input was fully drained, 1 when the caller has to finish
+ * the job with the read/write loop, or a negative errno on a hard error.
+ */
+
+static int64_t copy_zero(int in_fd, enum copy_method method) {
+  int64_t n;
+  for (;;) {
+    switch (method) {
+    case COPY_FILE_RANGE:
+      n = guicall(SYS_copy_file_range, in_fd, NULL, STDOUT_FILENO, NULL,
+                  ZC_CHUNK, 0);
+      break;
+    case COPY_SPLICE:
+      n = guicall(SYS_splice, in_fd, NULL, STDOUT_FILENO, NULL, ZC_CHUNK,
+                  SPLICE_F_MOVE | SPLICE_F_MORE);
+      break;
+    case COPY_SENDFILE:
+      n = guicall(SYS_sendfile, STDOUT_FILENO, in_fd, NULL, ZC_CHUNK);
+      break;
+    default:
+      return 1;
+    }
+
+    if (n == 0) {
+      return 0;
+    }
+    if (n < 0) {
+      if (n == -EINTR) {
+        continue;
+      }
+      // Offsets were advanced by whatever already went through, so the
+      // read/write loop can pick up exactly where we stopped.
+      if (n == -EINVAL || n == -EXDEV || n == -ENOSYS || n == -EOPNOTSUPP ||
+          n == -EBADF) {
+        return 1;
+      }
+      return n;
+    }
   }
+}
+
+/**
+ * @brief Plain read/write loop through an 8 KiB buffer. Used as the fallback
+ * for fd pairs that no zero-copy primitive supports.
+ *
+ * @return 0 on success, -1 on a read error, -2 on a write error.
+ */
+
+static int copy_rw(int in_fd) {
+  char buffer[(1024 * 8)];
   ssize_t bytes_read;
-  while ((bytes_read = guicall(SYS_read, fd, (int64_t)buffer, sizeof(buffer))) > 0) {
+  while ((bytes_read = guicall(SYS_read, in_fd, (int64_t)buffer, sizeof(buffer))) > 0) {
     ssize_t bytes_written = 0;
     while (bytes_written < bytes_read) {
       ssize_t result = guicall(SYS_write, STDOUT_FILENO, (int64_t)(buffer + bytes_written),
                                bytes_read - bytes_written);
       if (result < 0) {
-        error("Error writing in stdout.\n");
-        guicall(SYS_close, fd, 0, 0, 0, 0, 0);
-        guicall(SYS_exit, 1, 0, 0, 0, 0, 0);
+        return -2;
       }
       bytes_written += result;
     }
   }
-  if (bytes_read < 0) {
+  return bytes_read < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Copies everything from 'in_fd' to stdout, preferring the zero-copy
+ * path and falling back to read/write.
+ *
+ * @return 0 on success, -1 on a read error, -2 on a write error.
+ */
+
+static int copy_fd(int in_fd) {
+  enum copy_method method = pick_method(in_fd);
+  if (method != COPY_RW) {
+    int64_t ret = copy_zero(in_fd, method);
+    if (ret == 0) {
+      return 0;
+    }
+    if (ret < 0) {
+      // The zero-copy calls cannot tell us which side failed; a broken
+      // stdout is by far the common case.
+      return ret == -EIO ? -1 : -2;
+    }
+  }
+  return copy_rw(in_fd);
+}
+
+void cat(const char *pathname) {
+  int fd = guicall(SYS_open, (int64_t)pathname, O_RDONLY);
+  if (fd < 0) {
+    error("Mini-cat: ");
+    error(pathname);
+    error(": No such file or directory.\n");
+    gui_exit(1);
+  }
+  int ret = copy_fd(fd);
+  if (ret == -2) {
+    error("Error writing in stdout.\n");
+    guicall(SYS_close, fd, 0, 0, 0, 0, 0);
+    gui_exit(1);
+  }
+  if (ret == -1) {
     error("Error reading file!\n");
   }
   guicall(SYS_close, fd, 0, 0, 0, 0, 0);
 }
 
 void cat_stdin(void) {
-  char buffer[(1024 * 8)];
-  ssize_t bytes_read;
-  while ((bytes_read =
-              guicall(SYS_read, STDIN_FILENO, (int64_t)buffer, sizeof(buffer))) > 0) {
-    ssize_t bytes_written = 0;
-    while (bytes_written < bytes_read) {
-      ssize_t result = guicall(SYS_write, STDOUT_FILENO, (int64_t)(buffer + bytes_written),
-                               bytes_read - bytes_written);
-      if (result < 0) {
-        error("Error writing in stdout.\n");
-        guicall(SYS_exit, 1, 0, 0, 0, 0, 0);
-      }
-      bytes_written += result;
-    }
+  if (copy_fd(STDIN_FILENO) == -2) {
+    error("Error writing in stdout.\n");
+    gui_exit(1);
   }
 }
 
@@ -64,5 +203,5 @@ int main(int argc, const char *argv[]) {
       cat(argv[i]);
     }
   }
-  guicall(SYS_exit, 0, 0, 0, 0, 0, 0);
+  gui_exit(0);
 }
@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 
 #include "lib.h"
+#include "out.h"
 #include "sys/guicall.h"
 #include "sys/sysnums.h"
 
@@ -14,13 +15,13 @@ int main(int argc, const char *argv[]) {
     i = 1;
   }
   for (; i < argc; ++i) {
-    guicall(SYS_write, STDOUT_FILENO, argv[i], guilen(argv[i]));
+    gui_out_str(gui_stdout, argv[i]);
     if (i < argc - 1) {
-      guicall(SYS_write, STDOUT_FILENO, " ", 1);
+      gui_out_char(gui_stdout, ' ');
     }
   }
   if (!no_newline) {
-    guicall(SYS_write, STDOUT_FILENO, "\n", 1);
+    gui_out_char(gui_stdout, '\n');
   }
-  guicall(SYS_exit, 0);
+  gui_exit(0);
 }
@@ -2,11 +2,24 @@
 #define _FILE_OFFSET_BITS 64
 
 #include "lib.h"
+#include "out.h"
+#include "path.h"
+#include "deque.h"
+#include "thread.h"
 #include "sys/guicall.h"    
 #include "sys/sysnums.h"    
-#include <getopt.h>
+#include "sys/uring.h"
+#include "sort.h"
+#include "arena.h"
+#include "fmt.h"
+#include "ids.h"
+#include "opt.h"
+#include <errno.h>
 #include <linux/fcntl.h>
+#include <linux/mman.h>
+#include <linux/stat.h>
 #include <stdint.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 
@@ -39,12 +52,82 @@ struct stat64 {
   int64_t __unused[3];
 };
 
+#define LIST_BUF_SIZE (1024 * 32)
+#define NODE_CHUNK_SIZE (1024 * 64)
+// Output a DirNode buffers in place; only larger listings map memory.
+#define NODE_OUT_SIZE (1024 * 4)
+#define MAX_THREADS 256
+
+// Entries whose metadata is requested with one io_uring submission.
+#define STAT_BATCH 128
+// Transient io_uring_enter failures in a row before the ring is given up.
+#define RING_STALLS 64
+
+#define OPT_THREADS 256
+#define OPT_MAX_FD 257
+#define OPT_HELP 258
+#define OPT_STREAM 259
+#define OPT_STATS 260
+#define OPT_COUNT 261
+#define OPT_SUMMARY 262
+#define OPT_FORMAT 263
+
+// Descriptors left for stdio, io_uring rings and the like when the
+// --max-fd default is derived from RLIMIT_NOFILE.
+#define FD_RESERVE 32
+
+#define DT_UNKNOWN 0
+#define DT_FIFO 1
+#define DT_CHR 2
+#define DT_DIR 4
+#define DT_BLK 6
+#define DT_REG 8
+#define DT_LNK 10
+#define DT_SOCK 12
+
+// The only fields -l prints. Asking for less lets network and FUSE
+// filesystems skip work, and AT_STATX_DONT_SYNC lets them answer from
+// cached attributes instead of a server round trip.
+#define LONG_STATX_MASK                                                        \
+  (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID | STATX_SIZE)
+#define META_FLAGS (AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC)
+
+#define RLIMIT_NOFILE 7
+#define CLOCK_MONOTONIC 1
+
+// -C: columns are separated by two spaces, so none is narrower than three.
+#define COLUMN_GAP 2
+#define MIN_COLUMN_WIDTH 3
+#define DEFAULT_WIDTH 80
+
 typedef struct {
   int recursive;
   int all;
   int long_format;
+  int threads;
+  int sort;
+  int max_fd; // Directory fds the sequential walk may hold open.
+  int human;
+  int numeric; // -n: uid and gid as numbers, never looked up.
+  int columns; // -C: names down columns instead of one per line.
+  int width;   // Line width for -C, from the terminal or -w.
+  int stream;  // --stream: print each getdents64 batch as it arrives.
+  int stats;   // --stats: entry count and throughput on stderr at exit.
+  int count;   // --count: per-directory and total counts instead of names.
+  int summary; // --summary: --count plus byte and block totals.
+  int format;  // --format: FORMAT_TEXT, FORMAT_JSON or FORMAT_TSV.
+  char eol;    // Line terminator: '\n', or '\0' with -0.
 } Options;
 
+#define FORMAT_TEXT 0
+#define FORMAT_JSON 1 // One JSON object per line.
+#define FORMAT_TSV 2  // One tab-separated record per line.
+
+#define SORT_NAME 0
+#define SORT_NONE 1 // -U: directory order; unbuffered unless -l or -C.
+#define SORT_TIME 2
+#define SORT_SIZE 3
+
 void show_help() {
   const char *msg =
       "Mini-LS made by me\n"
@@ -53,44 +136,39 @@ void show_help() {
       "  -l, --long        use a long listing format (mode, uid, "
       "gid, size, etc)\n"
       "  -a, --all         do not ignore entries starting with .\n"
-      "  -r, --recursive   list subdirectories recursively\n\n"
+      "  -C                list entries by columns (default on a terminal)\n"
+      "  -1                list one entry per line\n"
+      "  -h, --human-readable\n"
+      "                    with -l, print sizes like 1.5K, 234M, 2.0G\n"
+      "  -n, --numeric-uid-gid\n"
+      "                    like -l, but list numeric user and group IDs\n"
+      "  -r, --recursive   list subdirectories recursively\n"
+      "  -t                sort by modification time, newest first\n"
+      "  -S                sort by file size, largest first\n"
+      "  -U                do not sort; list entries in directory order\n"
+      "  -w, --width=COLS  assume the screen is COLS columns wide\n"
+      "      --threads=N   with -r, list directories on N worker threads\n"
+      "      --max-fd=N    keep at most N directories open while walking\n"
+      "      --stream      print entries as they are read, unsorted; for\n"
+      "                    directories too large to buffer\n"
+      "      --stats       report entries listed and entries/s on stderr\n"
+      "      --count       print how many files and directories each\n"
+      "                    directory holds, and a total, instead of names\n"
+      "      --summary     like --count, plus bytes and 512-byte blocks\n"
+      "  -0, --zero        end each output line with NUL, not newline\n"
+      "      --format=FMT  text (default), json (one object per line) or\n"
+      "                    tsv; records carry the inode and type, and with\n"
+      "                    -l the statx fields\n"
+      "      --help        display this help and exit\n\n"
       "Example:\n"
       "  ./a.out -la /etc\n"
       "  ./a.out -r ~\n";
 
-  guicall(SYS_write, STDOUT_FILENO, msg, guilen(msg));
-  guicall(SYS_exit, 0);
+  gui_out_str(gui_stdout, msg);
+  gui_exit(0);
 }
 
-void write_num(int64_t num) {
-  char buf[32];
-  int i = 0;
-  int neg = 0;
-
-  if (num < 0) {
-    neg = 1;
-    num = -num;
-  }
-
-  if (num == 0) {
-    buf[i++] = '0';
-  } else {
-    while (num > 0) {
-      buf[i++] = '0' + (num % 10);
-      num /= 10;
-    }
-  }
-
-  if (neg) {
-    buf[i++] = '-';
-  }
-
-  for (int j = i - 1; j >= 0; --j) {
-    guicall(SYS_write, STDOUT_FILENO, &buf[j], 1);
-  }
-}
-
-void write_mode(uint32_t mode) {
+void write_mode(gui_out *out, uint32_t mode) {
   char perms[11] = "----------";
 
   if ((mode & 0170000) == 0040000)
@@ -117,184 +195,2037 @@ void write_mode(uint32_t mode) {
   if (mode & 0001)
     perms[9] = 'x';
 
-  guicall(SYS_write, STDOUT_FILENO, perms, 10);
+  gui_out_write(out, perms, 10);
+}
+
+void out_of_memory(void) {
+  const char *msg = "MMap syscall failed.\n";
+  gui_out_str(gui_stderr, msg);
+  gui_exit(1);
 }
 
-void show_long(const char *path, const char *name) {
-  char full[4096];
-  guicpy(full, path);
-  if (full[guilen(full) - 1] != '/') {
-    guicat(full, "/");
+/*
+ * =============
+ * =Owner names=
+ * =============
+ *
+ * One resolver per file for the whole run, so /etc/passwd and /etc/group
+ * are each read once however many entries are listed. Workers of the
+ * parallel walk share them under a lock; the names themselves live in the
+ * mappings and stay valid after it is released.
+ */
+
+static gui_ids users, groups;
+static gui_mutex ids_lock = GUI_MUTEX_INIT;
+
+/**
+ * @brief Name of 'id' from 'ids' with its length in 'len', or NULL with -n
+ * or when the file does not name it (the number is printed instead).
+ */
+
+const char *id_name(gui_ids *ids, uint32_t id, size_t *len, Options *opt) {
+  if (opt->numeric) {
+    return NULL;
+  }
+  gui_mutex_lock(&ids_lock);
+  const char *name = gui_ids_name(ids, id, len);
+  gui_mutex_unlock(&ids_lock);
+  return name;
+}
+
+/*
+ * ==========
+ * =Metadata=
+ * ==========
+ *
+ * Everything mini-ls needs to know beyond getdents64 comes from statx with
+ * the smallest mask that answers the question: STATX_TYPE to resolve a
+ * DT_UNKNOWN entry, LONG_STATX_MASK for -l. Nothing is stat'ed when d_type
+ * already tells us enough.
+ */
+
+static int have_statx = 1;
+
+/**
+ * @brief statx() of 'name' relative to 'dirfd', not following symlinks.
+ * Kernels without statx (before 4.11) are served by newfstatat.
+ * @return 0 on success or a negative errno.
+ */
+
+int meta_get(int dirfd, const char *name, unsigned mask, struct statx *stx) {
+  if (__atomic_load_n(&have_statx, __ATOMIC_RELAXED)) {
+    int ret = guicall(SYS_statx, dirfd, name, META_FLAGS, mask, stx);
+    if (ret != -ENOSYS) {
+      return ret;
+    }
+    __atomic_store_n(&have_statx, 0, __ATOMIC_RELAXED);
   }
-  guicat(full, name);
 
   struct stat64 info;
-  if (guicall(SYS_stat, full, &info) < 0) {
+  int ret = guicall(SYS_newfstatat, dirfd, name, &info, AT_SYMLINK_NOFOLLOW);
+  if (ret < 0) {
+    return ret;
+  }
+  // 'stx' may be reused arena memory: clear what stat cannot tell (birth
+  // time, attributes, mount id), then copy every basic field, so the mask
+  // is true whatever the caller asked for.
+  __builtin_memset(stx, 0, sizeof(*stx));
+  stx->stx_mask = STATX_BASIC_STATS;
+  stx->stx_blksize = info.st_blksize;
+  stx->stx_mode = info.st_mode;
+  stx->stx_nlink = info.st_nlink;
+  stx->stx_uid = info.st_uid;
+  stx->stx_gid = info.st_gid;
+  stx->stx_ino = info.st_ino;
+  stx->stx_size = info.st_size;
+  stx->stx_blocks = info.st_blocks;
+  stx->stx_atime.tv_sec = info.st_atime;
+  stx->stx_atime.tv_nsec = info.st_atime_nsec;
+  stx->stx_mtime.tv_sec = info.st_mtime;
+  stx->stx_mtime.tv_nsec = info.st_mtime_nsec;
+  stx->stx_ctime.tv_sec = info.st_ctime;
+  stx->stx_ctime.tv_nsec = info.st_ctime_nsec;
+  return 0;
+}
+
+/**
+ * @brief The d_type of an entry, asking the filesystem only when it
+ * reported DT_UNKNOWN (XFS without ftype, some FUSE and network mounts).
+ */
+
+unsigned char entry_type(int dirfd, struct linux_dirent64 *d) {
+  if (d->d_type != DT_UNKNOWN) {
+    return d->d_type;
+  }
+  struct statx stx;
+  if (meta_get(dirfd, d->d_name, STATX_TYPE, &stx) < 0) {
+    return DT_UNKNOWN;
+  }
+  // The same encoding as IFTODT(): the S_IFMT bits shifted down.
+  d->d_type = (stx.stx_mode & 0170000) >> 12;
+  return d->d_type;
+}
+
+/*
+ * Widths of the padded -l fields, widened entry by entry as metadata comes
+ * in, so the lines can be aligned without looking at any entry twice.
+ */
+
+typedef struct {
+  size_t nlink;
+  size_t user;
+  size_t group;
+  size_t size;
+} LongWidths;
+
+static inline size_t id_width(gui_ids *ids, uint32_t id, Options *opt) {
+  size_t len;
+  return id_name(ids, id, &len, opt) ? len : gui_fmt_digits(id);
+}
+
+static inline size_t size_width(uint64_t size, Options *opt) {
+  char buf[GUI_FMT_MAX];
+  return opt->human ? gui_fmt_human(buf, size) : gui_fmt_digits(size);
+}
+
+static inline void widen(size_t *width, size_t len) {
+  if (len > *width) {
+    *width = len;
+  }
+}
+
+void long_widths_add(LongWidths *w, const struct statx *stx, Options *opt) {
+  widen(&w->nlink, gui_fmt_digits(stx->stx_nlink));
+  widen(&w->user, id_width(&users, stx->stx_uid, opt));
+  widen(&w->group, id_width(&groups, stx->stx_gid, opt));
+  widen(&w->size, size_width(stx->stx_size, opt));
+}
+
+void write_spaces(gui_out *out, size_t count) {
+  static const char spaces[] = "                                ";
+  while (count > 0) {
+    size_t n = count < sizeof(spaces) - 1 ? count : sizeof(spaces) - 1;
+    gui_out_write(out, spaces, n);
+    count -= n;
+  }
+}
+
+/**
+ * @brief Prints 'len' bytes of 'text' right-aligned in 'width' columns.
+ * Numeric fields are never wider than GUI_FMT_MAX.
+ */
+
+void write_right(gui_out *out, const char *text, size_t len, size_t width) {
+  char field[GUI_FMT_MAX];
+  if (width > sizeof(field)) {
+    width = sizeof(field);
+  }
+  gui_out_write(out, field, gui_fmt_pad(field, text, len, width));
+}
+
+/**
+ * @brief Prints the owner or group 'id' in 'width' columns: a name
+ * left-aligned, a number right-aligned, as GNU ls does.
+ */
+
+void write_id(gui_out *out, gui_ids *ids, uint32_t id, size_t width,
+              Options *opt) {
+  size_t len;
+  const char *name = id_name(ids, id, &len, opt);
+  if (name == NULL) {
+    char num[GUI_FMT_MAX];
+    write_right(out, num, gui_fmt_u64(num, id), width);
     return;
   }
+  gui_out_write(out, name, len);
+  if (len < width) {
+    write_spaces(out, width - len);
+  }
+}
+
+/**
+ * @brief Formats one -l line with its fields padded to 'w'. Symlink targets
+ * are read here, relative to 'dirfd'.
+ */
+
+void write_long(gui_out *out, int dirfd, const char *name,
+                const struct statx *stx, const LongWidths *w, Options *opt) {
+  char num[GUI_FMT_MAX];
 
-  write_mode(info.st_mode);
-  guicall(SYS_write, STDOUT_FILENO, " ", 1);
-  write_num(info.st_nlink);
-  guicall(SYS_write, STDOUT_FILENO, " ", 1);
-  write_num(info.st_uid);
-  guicall(SYS_write, STDOUT_FILENO, " ", 1);
-  write_num(info.st_gid);
-  guicall(SYS_write, STDOUT_FILENO, " ", 1);
-  write_num(info.st_size);
-  guicall(SYS_write, STDOUT_FILENO, " ", 1);
-  guicall(SYS_write, STDOUT_FILENO, name, guilen(name));
+  write_mode(out, stx->stx_mode);
+  gui_out_char(out, ' ');
+  write_right(out, num, gui_fmt_u64(num, stx->stx_nlink), w->nlink);
+  gui_out_char(out, ' ');
+  write_id(out, &users, stx->stx_uid, w->user, opt);
+  gui_out_char(out, ' ');
+  write_id(out, &groups, stx->stx_gid, w->group, opt);
+  gui_out_char(out, ' ');
+  if (opt->human) {
+    write_right(out, num, gui_fmt_human(num, stx->stx_size), w->size);
+  } else {
+    write_right(out, num, gui_fmt_u64(num, stx->stx_size), w->size);
+  }
+  gui_out_char(out, ' ');
+  gui_out_str(out, name);
 
-  if ((info.st_mode & 0170000) == 0120000) {
+  if ((stx->stx_mode & 0170000) == 0120000) {
     char target[4096];
-    int len = guicall(SYS_readlink, full, target, sizeof(target) - 1);
+    int len = guicall(SYS_readlinkat, dirfd, name, target, sizeof(target) - 1);
     if (len > 0) {
       target[len] = '\0';
-      guicall(SYS_write, STDOUT_FILENO, " -> ", 4);
-      guicall(SYS_write, STDOUT_FILENO, target, len);
+      gui_out_write(out, " -> ", 4);
+      gui_out_write(out, target, len);
     }
   }
 
-  guicall(SYS_write, STDOUT_FILENO, "\n", 1);
+  gui_out_char(out, opt->eol);
 }
 
-void list(const char *path, Options *opt);
+/*
+ * =========================
+ * =Machine-readable output=
+ * =========================
+ *
+ * --format=json and --format=tsv print one record per entry with its inode
+ * and type from getdents64 and, with -l, the statx fields as numbers, so
+ * consumers never stat what was listed. Names go through the escapers of
+ * out.c straight into the output buffer, so a record is always one line.
+ *
+ *   json: {"name":"a b","ino":12,"type":"file","mode":33188,"nlink":1,
+ *          "uid":0,"gid":0,"size":5,"blocks":8,"mtime":1700000000,
+ *          "mtime_nsec":0,"target":"..."}   (target for symlinks only)
+ *   tsv:  name ino type [mode nlink uid gid size blocks mtime mtime_nsec
+ *         target]   (target empty unless a symlink)
+ *
+ * Directory headers are {"dir":"<path>"} objects in JSON and one-field
+ * "<path>:" lines in TSV, where entry records have at least three fields.
+ */
 
-void scan_recursive(const char *path, Options *opt) {
-  int fd = guicall(SYS_open, path, O_RDONLY | O_DIRECTORY);
-  if (fd < 0) {
+const char *type_name(unsigned type) {
+  switch (type) {
+  case DT_FIFO:
+    return "fifo";
+  case DT_CHR:
+    return "char";
+  case DT_DIR:
+    return "dir";
+  case DT_BLK:
+    return "block";
+  case DT_REG:
+    return "file";
+  case DT_LNK:
+    return "link";
+  case DT_SOCK:
+    return "socket";
+  default:
+    return "unknown";
+  }
+}
+
+/**
+ * @brief Appends one record field: '"key":' ahead of a JSON value, a tab
+ * ahead of a TSV one. 'json_key' is the JSON form, comma included.
+ */
+
+static inline void record_key(gui_out *out, const char *json_key,
+                              Options *opt) {
+  if (opt->format == FORMAT_JSON) {
+    gui_out_str(out, json_key);
+  } else {
+    gui_out_char(out, '\t');
+  }
+}
+
+static inline void record_num(gui_out *out, const char *json_key, uint64_t v,
+                              Options *opt) {
+  record_key(out, json_key, opt);
+  gui_out_unum(out, v);
+}
+
+static inline void record_text(gui_out *out, const char *text, size_t len,
+                               Options *opt) {
+  if (opt->format == FORMAT_JSON) {
+    gui_out_char(out, '"');
+    gui_out_json(out, text, len);
+    gui_out_char(out, '"');
+  } else {
+    gui_out_tsv(out, text, len);
+  }
+}
+
+/**
+ * @brief Formats the record of entry 'name' ('len' bytes, NUL-terminated).
+ * 'stx' is NULL without -l; a DT_UNKNOWN 'type' is then left as is.
+ */
+
+void write_record(gui_out *out, int dirfd, const char *name, size_t len,
+                  uint64_t ino, unsigned type, const struct statx *stx,
+                  Options *opt) {
+  if (type == DT_UNKNOWN && stx != NULL) {
+    type = (stx->stx_mode & 0170000) >> 12;
+  }
+  if (opt->format == FORMAT_JSON) {
+    gui_out_str(out, "{\"name\":");
+  }
+  record_text(out, name, len, opt);
+  record_num(out, ",\"ino\":", ino, opt);
+  record_key(out, ",\"type\":", opt);
+  const char *tname = type_name(type);
+  record_text(out, tname, guilen(tname), opt);
+
+  if (stx != NULL) {
+    record_num(out, ",\"mode\":", stx->stx_mode, opt);
+    record_num(out, ",\"nlink\":", stx->stx_nlink, opt);
+    record_num(out, ",\"uid\":", stx->stx_uid, opt);
+    record_num(out, ",\"gid\":", stx->stx_gid, opt);
+    record_num(out, ",\"size\":", stx->stx_size, opt);
+    record_num(out, ",\"blocks\":", stx->stx_blocks, opt);
+    record_key(out, ",\"mtime\":", opt);
+    gui_out_num(out, stx->stx_mtime.tv_sec);
+    record_num(out, ",\"mtime_nsec\":", stx->stx_mtime.tv_nsec, opt);
+
+    char target[4096];
+    int tlen = 0;
+    if ((stx->stx_mode & 0170000) == 0120000) {
+      tlen = guicall(SYS_readlinkat, dirfd, name, target, sizeof(target));
+    }
+    if (tlen > 0) {
+      record_key(out, ",\"target\":", opt);
+      record_text(out, target, (size_t)tlen, opt);
+    } else if (opt->format == FORMAT_TSV) {
+      gui_out_char(out, '\t');
+    }
+  }
+
+  if (opt->format == FORMAT_JSON) {
+    gui_out_char(out, '}');
+  }
+  gui_out_char(out, opt->eol);
+}
+
+/**
+ * @brief Prints the "<path>:" header of a directory, after a blank line
+ * unless it is the 'first' thing printed.
+ */
+
+void write_header(gui_out *out, const char *path, size_t len, int first,
+                  Options *opt) {
+  if (opt->format == FORMAT_JSON) {
+    gui_out_str(out, "{\"dir\":\"");
+    gui_out_json(out, path, len);
+    gui_out_str(out, "\"}");
+  } else {
+    if (!first && opt->format == FORMAT_TEXT) {
+      gui_out_char(out, opt->eol);
+    }
+    if (opt->format == FORMAT_TSV) {
+      gui_out_tsv(out, path, len);
+    } else {
+      gui_out_write(out, path, len);
+    }
+    gui_out_char(out, ':');
+  }
+  gui_out_char(out, opt->eol);
+}
+
+/*
+ * ======================
+ * =Batched -l metadata=
+ * ======================
+ *
+ * The metadata of a directory's entries is requested with IORING_OP_STATX,
+ * STAT_BATCH entries per io_uring_enter, instead of one blocking stat per
+ * entry (see table_fetch_meta()).
+ *
+ * When io_uring is missing, disabled, or too old to know STATX, every entry
+ * goes through meta_get() instead.
+ */
+
+typedef struct {
+  gui_uring ring;
+  int use_ring;
+  Options *opt;
+} StatBatch;
+
+void ring_failed(void) {
+  const char *msg = "io_uring_enter syscall failed.\n";
+  gui_out_str(gui_stderr, msg);
+  gui_exit(1);
+}
+
+StatBatch *stat_batch_new(Options *opt) {
+  int64_t mem = guicall(SYS_mmap, NULL, sizeof(StatBatch),
+                        PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                        -1, 0);
+  if (mem < 0) {
+    out_of_memory();
+  }
+  StatBatch *batch = (StatBatch *)mem;
+  batch->use_ring = gui_uring_init(&batch->ring, STAT_BATCH) == 0;
+  if (batch->use_ring &&
+      !gui_uring_supported(&batch->ring, IORING_OP_STATX)) {
+    gui_uring_exit(&batch->ring);
+    batch->use_ring = 0;
+  }
+  batch->opt = opt;
+  return batch;
+}
+
+/*
+ * Names of the subdirectories found while listing a directory, in an arena
+ * the caller rewinds once it is done with them. Recursion walks this list
+ * instead of reading the directory a second time.
+ */
+
+typedef struct Name {
+  struct Name *next;
+  char name[];
+} Name;
+
+typedef struct {
+  Name *head;
+  Name **tail;
+  gui_arena *arena;
+} NameList;
+
+void names_init(NameList *names, gui_arena *arena) {
+  names->head = NULL;
+  names->tail = &names->head;
+  names->arena = arena;
+}
+
+void names_add(NameList *names, const char *name) {
+  size_t len = guilen(name) + 1;
+  Name *node = gui_arena_alloc(names->arena, sizeof(Name) + len);
+  if (node == NULL) {
+    out_of_memory();
+  }
+  node->next = NULL;
+  guimemcpy(node->name, name, len);
+  *names->tail = node;
+  names->tail = &node->next;
+}
+
+/*
+ * ================
+ * =Sorted listing=
+ * ================
+ *
+ * Unless -U is given alone, a directory's entries are copied into an
+ * EntryTable (one growable mapping, reused for every directory), their
+ * metadata is fetched in batches when the output or the sort order needs
+ * it, and the (key, pointer) pairs are sorted (except with -U) before
+ * anything is printed. -l and -C need every entry before the first line
+ * anyway, to know how wide the columns are.
+ */
+
+typedef struct {
+  int res; // Metadata fetch result: 0 when entry_meta() is valid, or -errno.
+  uint16_t len;
+  uint16_t width; // Columns the name takes with -C, '/' included.
+  uint64_t ino;
+  unsigned char type;
+  unsigned char shown; // 0 for hidden subdirectories kept only for -r.
+  char name[];
+} Entry;
+
+typedef struct {
+  gui_sort_item *items; // One per entry, 'ptr' pointing at Entry.name.
+  size_t count;
+  size_t cap; // In bytes.
+  int with_meta; // Each Entry is followed by a struct statx.
+  LongWidths widths; // Of the shown entries whose metadata was read.
+} EntryTable;
+
+/*
+ * Per-thread listing state: the sequential listing has one, every worker of
+ * the parallel one has its own.
+ */
+
+typedef struct {
+  char *buf;
+  size_t size; // Asked for by the next getdents64.
+  size_t cap;  // Mapped.
+} StreamBuf;
+
+typedef struct {
+  uint64_t files; // Everything but directories.
+  uint64_t dirs;
+  uint64_t bytes; // --summary only.
+  uint64_t blocks;
+  uint64_t counted; // Directories summed up, for the total line.
+} Counts;
+
+typedef struct {
+  StatBatch *stat; // With -l, -t or -S.
+  EntryTable table;
+  gui_arena scratch; // Entries of the directory being listed.
+  gui_arena names;   // Subdirectories still to be descended into.
+  gui_pool bufs;     // getdents64 buffers.
+  StreamBuf stream;  // --stream: one adaptive buffer instead.
+  uint64_t entries;  // --stats counters.
+  uint64_t reads;
+  size_t peak_read;
+  Counts totals;     // --count: every directory this lister counted.
+  int ready;
+} Lister;
+
+void lister_init(Lister *ls, Options *opt) {
+  if (!ls->ready) {
+    // Entry records of a huge directory can reach many megabytes.
+    gui_arena_init(&ls->scratch, 0, GUI_ARENA_HUGE);
+    gui_arena_init(&ls->names, 0, 0);
+    gui_pool_init(&ls->bufs, LIST_BUF_SIZE);
+    ls->ready = 1;
+  }
+  if (ls->stat == NULL && (opt->long_format || opt->summary ||
+                           opt->sort == SORT_TIME || opt->sort == SORT_SIZE)) {
+    ls->stat = stat_batch_new(opt);
+  }
+}
+
+static inline size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+static inline struct statx *entry_meta(Entry *e) {
+  return (struct statx *)((char *)e + align8(sizeof(Entry) + e->len + 1));
+}
+
+static inline Entry *entry_of_name(const void *name) {
+  return (Entry *)((const char *)name - __builtin_offsetof(Entry, name));
+}
+
+/**
+ * @brief Grows the mapping at '*buf' so it holds at least 'need' bytes.
+ */
+
+void reserve(void *buf, size_t *cap, size_t need) {
+  void **p = (void **)buf;
+  if (need <= *cap) {
     return;
   }
+  size_t new_cap = *cap ? *cap * 2 : 1024 * 64;
+  while (new_cap < need) {
+    new_cap *= 2;
+  }
+  int64_t mem;
+  if (*p == NULL) {
+    mem = guicall(SYS_mmap, NULL, new_cap, PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  } else {
+    mem = guicall(SYS_mremap, *p, *cap, new_cap, MREMAP_MAYMOVE);
+  }
+  if (mem < 0) {
+    out_of_memory();
+  }
+  *p = (void *)mem;
+  *cap = new_cap;
+}
+
+/**
+ * @brief Whether code point 'c' takes two terminal columns (East Asian wide
+ * and fullwidth ranges, emoji).
+ */
+
+static int is_wide(uint32_t c) {
+  return (c >= 0x1100 && c <= 0x115f) || (c >= 0x2e80 && c <= 0xa4cf) ||
+         (c >= 0xac00 && c <= 0xd7a3) || (c >= 0xf900 && c <= 0xfaff) ||
+         (c >= 0xfe30 && c <= 0xfe4f) || (c >= 0xff00 && c <= 0xff60) ||
+         (c >= 0xffe0 && c <= 0xffe6) || (c >= 0x1f300 && c <= 0x1f64f) ||
+         (c >= 0x1f900 && c <= 0x1f9ff) || (c >= 0x20000 && c <= 0x3fffd);
+}
+
+/**
+ * @brief Terminal columns taken by 'len' bytes of UTF-8: one per character,
+ * two for wide ones. Only three and four byte sequences can be wide, so
+ * everything else is counted without decoding.
+ */
+
+size_t text_width(const char *text, size_t len) {
+  const unsigned char *p = (const unsigned char *)text;
+  size_t width = 0;
+  for (size_t i = 0; i < len; ++i) {
+    if ((p[i] & 0xc0) == 0x80) {
+      continue;
+    }
+    ++width;
+    if (p[i] >= 0xe0 && p[i] < 0xf8) {
+      size_t n = p[i] >= 0xf0 ? 4 : 3;
+      uint32_t c = p[i] & (n == 4 ? 0x07 : 0x0f);
+      for (size_t j = 1; j < n && i + j < len; ++j) {
+        c = (c << 6) | (p[i + j] & 0x3f);
+      }
+      width += is_wide(c);
+    }
+  }
+  return width;
+}
+
+void table_add(Lister *ls, struct linux_dirent64 *d, size_t len, int shown) {
+  EntryTable *table = &ls->table;
+  size_t size = align8(sizeof(Entry) + len + 1);
+  if (table->with_meta) {
+    size += sizeof(struct statx);
+  }
+  Entry *e = gui_arena_alloc(&ls->scratch, size);
+  if (e == NULL) {
+    out_of_memory();
+  }
+  e->res = -ENODATA;
+  e->len = (uint16_t)len;
+  e->width = (uint16_t)(text_width(d->d_name, len) + (d->d_type == DT_DIR));
+  e->ino = d->d_ino;
+  e->type = d->d_type;
+  e->shown = (unsigned char)shown;
+  guimemcpy(e->name, d->d_name, len + 1);
+
+  reserve(&table->items, &table->cap,
+          (table->count + 1) * sizeof(gui_sort_item));
+  table->items[table->count++].ptr = e->name;
+}
+
+/**
+ * @brief Records the result of an entry's metadata fetch, widening the -l
+ * columns for the ones that will be printed.
+ */
+
+static inline void entry_fetched(EntryTable *table, Entry *e, int res,
+                                 Options *opt) {
+  e->res = res;
+  if (res == 0 && e->shown && opt->long_format &&
+      opt->format == FORMAT_TEXT) {
+    long_widths_add(&table->widths, entry_meta(e), opt);
+  }
+}
+
+static int ring_transient(int err) {
+  return err == -EAGAIN || err == -EBUSY || err == -ENOMEM;
+}
+
+/**
+ * @brief Gives up the ring after a submission failed with 'outstanding'
+ * requests of the batch not yet reaped. Those the kernel already took keep
+ * writing their struct statx into the entries, arena memory the caller
+ * rewinds for the next directory, so they are waited for before the ring
+ * is closed; closing it does not stop them.
+ */
+
+static void stat_batch_drop_ring(StatBatch *batch, unsigned outstanding) {
+  gui_uring *ring = &batch->ring;
+  unsigned in_flight = outstanding - gui_uring_discard_sqes(ring);
+  unsigned stalls = 0;
+  while (in_flight > 0) {
+    int ret = gui_uring_submit(ring, in_flight);
+    if (ret < 0 && (!ring_transient(ret) || ++stalls > RING_STALLS)) {
+      ring_failed();
+    }
+    while (in_flight > 0 && gui_uring_peek_cqe(ring) != NULL) {
+      gui_uring_cqe_seen(ring);
+      --in_flight;
+    }
+  }
+  gui_uring_exit(ring);
+  batch->use_ring = 0;
+}
+
+/**
+ * @brief Fills in the metadata of every entry, STAT_BATCH statx requests per
+ * io_uring_enter, or one by one without a ring.
+ */
+
+void table_fetch_meta(EntryTable *table, StatBatch *batch, int dirfd,
+                      unsigned mask) {
+  size_t next = 0;
+  while (next < table->count) {
+    if (!batch->use_ring) {
+      Entry *e = entry_of_name(table->items[next++].ptr);
+      entry_fetched(table, e, meta_get(dirfd, e->name, mask, entry_meta(e)),
+                    batch->opt);
+      continue;
+    }
+
+    unsigned queued = 0;
+    while (next < table->count && queued < STAT_BATCH) {
+      Entry *e = entry_of_name(table->items[next++].ptr);
+      struct io_uring_sqe *sqe = gui_uring_get_sqe(&batch->ring);
+      gui_uring_prep_statx(sqe, dirfd, e->name, META_FLAGS, mask,
+                           entry_meta(e), (uint64_t)(uintptr_t)e);
+      ++queued;
+    }
+
+    unsigned done = 0;
+    unsigned stalls = 0;
+    while (done < queued) {
+      int ret = gui_uring_submit(&batch->ring, queued - done);
+      if (ret < 0 && ring_transient(ret) && ++stalls <= RING_STALLS) {
+        // Out of request memory or completion room for now: reap what is
+        // ready, let the kernel catch up and submit again.
+        guicall(SYS_sched_yield);
+      } else if (ret < 0) {
+        // Start over synchronously; entries already fetched are redone.
+        stat_batch_drop_ring(batch, queued - done);
+        table_fetch_meta(table, batch, dirfd, mask);
+        return;
+      } else {
+        stalls = 0;
+      }
+      struct io_uring_cqe *cqe;
+      while ((cqe = gui_uring_peek_cqe(&batch->ring)) != NULL) {
+        Entry *done_entry = (Entry *)(uintptr_t)cqe->user_data;
+        entry_fetched(table, done_entry, cqe->res, batch->opt);
+        gui_uring_cqe_seen(&batch->ring);
+        ++done;
+      }
+    }
+  }
+}
 
-  size_t buf_size = (1024 * 32);
-  char *buf = (char *)guicall(SYS_mmap, NULL, buf_size, PROT_READ | PROT_WRITE,
-                              MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-  if (buf == MAP_FAILED) {
-    guicall(SYS_close, fd);
+static int tie_name(const void *a, const void *b) {
+  return guicmp((const char *)a, (const char *)b);
+}
+
+/**
+ * @brief The -t/-S sort key of an entry; the largest value sorts first.
+ * Entries without metadata go last.
+ */
+
+uint64_t entry_key(Entry *e, int sort) {
+  if (e->res != 0) {
+    return UINT64_MAX;
+  }
+  struct statx *stx = entry_meta(e);
+  if (sort == SORT_SIZE) {
+    return ~stx->stx_size;
+  }
+  // Seconds biased by 2^33 (1698..2242 stays in range) above 30 bits of
+  // nanoseconds.
+  int64_t sec = stx->stx_mtime.tv_sec + ((int64_t)1 << 33);
+  if (sec < 0) {
+    sec = 0;
+  } else if (sec >= (int64_t)1 << 34) {
+    sec = ((int64_t)1 << 34) - 1;
+  }
+  return ~(((uint64_t)sec << 30) | stx->stx_mtime.tv_nsec);
+}
+
+/*
+ * -C layout: names run down the columns, each column as wide as its widest
+ * name plus COLUMN_GAP, with as many columns as fit in opt->width. Every
+ * candidate column count is evaluated in the same single pass over the
+ * precomputed name widths (as GNU ls does): names fill a candidate's
+ * columns 'rows' at a time, so it only needs a cursor, its running column
+ * widths and its line length. Candidates whose line gets too long drop out,
+ * and the widest still valid one bounds the inner loop.
+ */
+
+typedef struct {
+  size_t line; // Sum of the column widths, gaps included.
+  size_t *cols;
+  size_t rows;
+  size_t row; // Cursor: where the next name goes.
+  size_t col;
+  int valid;
+} ColumnFit;
+
+/**
+ * @brief Finds the largest column count for the 'count' entries of
+ * 'shown', leaving the column widths of that layout in '*widths'.
+ */
+
+size_t fit_columns(Entry **shown, size_t count, size_t width,
+                   gui_arena *arena, size_t **widths) {
+  size_t max_cols = width / MIN_COLUMN_WIDTH;
+  if (max_cols < 1) {
+    max_cols = 1;
+  }
+  if (max_cols > count) {
+    max_cols = count;
+  }
+
+  ColumnFit *fits = gui_arena_alloc(arena, max_cols * sizeof(ColumnFit));
+  size_t *cols =
+      gui_arena_alloc(arena, max_cols * (max_cols + 1) / 2 * sizeof(size_t));
+  if (fits == NULL || cols == NULL) {
+    out_of_memory();
+  }
+  for (size_t c = 1; c <= max_cols; ++c) {
+    ColumnFit *fit = &fits[c - 1];
+    fit->line = c * MIN_COLUMN_WIDTH;
+    fit->cols = cols;
+    fit->rows = (count + c - 1) / c;
+    fit->row = 0;
+    fit->col = 0;
+    fit->valid = 1;
+    for (size_t j = 0; j < c; ++j) {
+      *cols++ = MIN_COLUMN_WIDTH;
+    }
+  }
+
+  size_t best = max_cols;
+  for (size_t i = 0; i < count; ++i) {
+    size_t name = shown[i]->width;
+    for (size_t c = 1; c <= best; ++c) {
+      ColumnFit *fit = &fits[c - 1];
+      size_t col = fit->col;
+      if (++fit->row == fit->rows) {
+        fit->row = 0;
+        ++fit->col;
+      }
+      if (!fit->valid) {
+        continue;
+      }
+      size_t need = name + (col == c - 1 ? 0 : COLUMN_GAP);
+      if (fit->cols[col] < need) {
+        fit->line += need - fit->cols[col];
+        fit->cols[col] = need;
+        fit->valid = fit->line < width;
+      }
+    }
+    while (best > 1 && !fits[best - 1].valid) {
+      --best;
+    }
+  }
+  *widths = fits[best - 1].cols;
+  return best;
+}
+
+void write_columns(gui_out *out, Entry **shown, size_t count,
+                   gui_arena *arena, Options *opt) {
+  if (count == 0) {
     return;
   }
+  size_t *widths;
+  size_t cols = fit_columns(shown, count, (size_t)opt->width, arena, &widths);
+  size_t rows = (count + cols - 1) / cols;
+
+  for (size_t row = 0; row < rows; ++row) {
+    for (size_t col = 0, i = row; i < count; ++col, i += rows) {
+      Entry *e = shown[i];
+      gui_out_write(out, e->name, e->len);
+      if (e->type == DT_DIR) {
+        gui_out_char(out, '/');
+      }
+      if (i + rows < count) {
+        write_spaces(out, widths[col] - e->width);
+      }
+    }
+    gui_out_char(out, '\n');
+  }
+}
+
+/**
+ * @brief Empties the lister's table for a new directory (or --stream batch).
+ * @return The statx mask the output and the sort order need, 0 for none.
+ */
+
+unsigned table_begin(Lister *ls, Options *opt) {
+  EntryTable *table = &ls->table;
+  unsigned mask = opt->long_format ? LONG_STATX_MASK : 0;
+  if (opt->summary || (opt->long_format && opt->format != FORMAT_TEXT)) {
+    mask |= STATX_SIZE | STATX_BLOCKS;
+  }
+  if (opt->long_format && opt->format != FORMAT_TEXT) {
+    mask |= STATX_MTIME;
+  }
+  if (opt->sort == SORT_TIME) {
+    mask |= STATX_MTIME;
+  } else if (opt->sort == SORT_SIZE) {
+    mask |= STATX_SIZE;
+  }
+  table->count = 0;
+  table->with_meta = mask != 0;
+  table->widths = (LongWidths){0, 0, 0, 0};
+  return mask;
+}
+
+/**
+ * @brief Adds the entries of one getdents64 batch to the table.
+ */
+
+void table_gather(Lister *ls, int fd, char *buf, size_t nread,
+                  Options *opt) {
+  for (size_t bpos = 0; bpos < nread;) {
+    struct linux_dirent64 *d = (void *)(buf + bpos);
+    bpos += d->d_reclen;
+    if (guicmp(d->d_name, ".") == 0 || guicmp(d->d_name, "..") == 0) {
+      continue;
+    }
+    ++ls->entries;
+    int shown = opt->all || d->d_name[0] != '.';
+    if (!opt->long_format || opt->recursive) {
+      entry_type(fd, d);
+    }
+    // Hidden subdirectories are still descended into without -a.
+    if (shown || (opt->recursive && d->d_type == DT_DIR)) {
+      table_add(ls, d, guilen(d->d_name), shown);
+    }
+  }
+}
+
+/**
+ * @brief Fetches the metadata the table needs, sorts it and formats it into
+ * 'out'. With -r, 'subdirs' receives the subdirectories in the sorted
+ * order, so recursion follows it too.
+ */
+
+void table_emit(Lister *ls, int fd, unsigned mask, gui_out *out,
+                NameList *subdirs, Options *opt) {
+  EntryTable *table = &ls->table;
+  if (table->with_meta) {
+    table_fetch_meta(table, ls->stat, fd, mask);
+  }
+
+  if (opt->sort == SORT_NAME) {
+    gui_sort_strings(table->items, table->count);
+  } else if (opt->sort != SORT_NONE) {
+    for (size_t i = 0; i < table->count; ++i) {
+      table->items[i].key =
+          entry_key(entry_of_name(table->items[i].ptr), opt->sort);
+    }
+    gui_sort(table->items, table->count, tie_name);
+  }
+
+  Entry **shown = NULL;
+  size_t shown_count = 0;
+  if (opt->columns && !opt->long_format) {
+    shown = gui_arena_alloc(&ls->scratch, table->count * sizeof(Entry *));
+    if (shown == NULL && table->count > 0) {
+      out_of_memory();
+    }
+  }
+
+  for (size_t i = 0; i < table->count; ++i) {
+    Entry *e = entry_of_name(table->items[i].ptr);
+    if (opt->recursive && e->type == DT_DIR) {
+      names_add(subdirs, e->name);
+    }
+    if (!e->shown) {
+      continue;
+    }
+    if (opt->format != FORMAT_TEXT) {
+      // With -l, entries whose metadata could not be read are dropped.
+      if (!opt->long_format || e->res == 0) {
+        write_record(out, fd, e->name, e->len, e->ino, e->type,
+                     opt->long_format ? entry_meta(e) : NULL, opt);
+      }
+    } else if (opt->long_format) {
+      // Entries whose metadata could not be read are dropped, as before.
+      if (e->res == 0) {
+        write_long(out, fd, e->name, entry_meta(e), &table->widths, opt);
+      }
+    } else if (shown != NULL) {
+      shown[shown_count++] = e;
+    } else {
+      gui_out_write(out, e->name, e->len);
+      if (e->type == DT_DIR) {
+        gui_out_char(out, '/');
+      }
+      gui_out_char(out, opt->eol);
+    }
+  }
+  if (shown != NULL) {
+    write_columns(out, shown, shown_count, &ls->scratch, opt);
+  }
+}
+
+/**
+ * @brief Reads the whole directory open on 'fd' into the lister's table,
+ * sorts it and formats it into 'out'.
+ */
+
+void sort_entries(int fd, char *buf, size_t buf_size, gui_out *out,
+                  NameList *subdirs, Lister *ls, Options *opt) {
+  gui_arena_mark mark = gui_arena_save(&ls->scratch);
+  unsigned mask = table_begin(ls, opt);
 
   int nread;
   while ((nread = guicall(SYS_getdents64, fd, buf, buf_size)) > 0) {
-    for (size_t bpos = 0; bpos < (size_t)nread;) {
-      struct linux_dirent64 *d = (void *)(buf + bpos);
-      if (guicmp(d->d_name, ".") != 0 && guicmp(d->d_name, "..") != 0) {
-        if (d->d_type == 4) {
-          char subpath[4096];
-          guicpy(subpath, path);
-          if (subpath[guilen(subpath) - 1] != '/') {
-            guicat(subpath, "/");
-          }
-          guicat(subpath, d->d_name);
+    ++ls->reads;
+    table_gather(ls, fd, buf, (size_t)nread, opt);
+  }
 
-          guicall(SYS_write, STDOUT_FILENO, "\n", 1);
-          guicall(SYS_write, STDOUT_FILENO, subpath, guilen(subpath));
-          guicall(SYS_write, STDOUT_FILENO, ":\n", 2);
-          list(subpath, opt);
-        }
-      }
-      bpos += d->d_reclen;
+  table_emit(ls, fd, mask, out, subdirs, opt);
+  gui_arena_rewind(&ls->scratch, mark);
+}
+
+/*
+ * ===========
+ * =Streaming=
+ * ===========
+ *
+ * -U without -l or -C formats names straight out of each getdents64 batch.
+ * --stream goes further for huge directories: every batch is printed (and,
+ * with -l, stat'ed and aligned on its own) and flushed as soon as it
+ * arrives, so the first line appears after one getdents64 call and memory
+ * stays at one batch. Its buffer starts small for a quick first batch and
+ * doubles, up to STREAM_BUF_MAX, whenever a read comes back full.
+ */
+
+#define STREAM_BUF_MIN (1024 * 32)
+#define STREAM_BUF_MAX (1024 * 1024 * 4)
+
+// A read that left less room than one maximal record probably stopped
+// because the buffer was full.
+#define DIRENT_MAX 280
+
+/**
+ * @brief One getdents64 call into the lister's stream buffer, growing the
+ * buffer for the next call when this one filled it.
+ */
+
+int stream_read(Lister *ls, int fd) {
+  StreamBuf *sb = &ls->stream;
+  reserve(&sb->buf, &sb->cap, sb->size);
+  int nread = guicall(SYS_getdents64, fd, sb->buf, sb->size);
+  if (nread > 0 && (size_t)nread > ls->peak_read) {
+    ls->peak_read = (size_t)nread;
+  }
+  if (nread > 0 && sb->size - (size_t)nread < DIRENT_MAX &&
+      sb->size < STREAM_BUF_MAX) {
+    sb->size *= 2;
+  }
+  return nread;
+}
+
+/**
+ * @brief Formats the names of one getdents64 batch, in directory order.
+ */
+
+void stream_names(Lister *ls, int fd, char *buf, size_t nread, gui_out *out,
+                  NameList *subdirs, Options *opt) {
+  for (size_t bpos = 0; bpos < nread;) {
+    struct linux_dirent64 *d = (void *)(buf + bpos);
+    bpos += d->d_reclen;
+    if (guicmp(d->d_name, ".") == 0 || guicmp(d->d_name, "..") == 0) {
+      continue;
+    }
+    ++ls->entries;
+
+    // Subdirectories are remembered for -r in this same pass. Hidden ones
+    // are still descended into without -a, as before.
+    if (opt->recursive && entry_type(fd, d) == DT_DIR) {
+      names_add(subdirs, d->d_name);
+    }
+    if (!opt->all && d->d_name[0] == '.') {
+      continue;
+    }
+
+    if (opt->format != FORMAT_TEXT) {
+      write_record(out, fd, d->d_name, guilen(d->d_name), d->d_ino,
+                   entry_type(fd, d), NULL, opt);
+      continue;
+    }
+    gui_out_str(out, d->d_name);
+    if (entry_type(fd, d) == DT_DIR) {
+      gui_out_char(out, '/');
+    }
+    gui_out_char(out, opt->eol);
+  }
+}
+
+void stream_entries(int fd, char *buf, size_t buf_size, gui_out *out,
+                    NameList *subdirs, Lister *ls, Options *opt) {
+  ls->stream.size = STREAM_BUF_MIN;
+  for (;;) {
+    int nread;
+    if (opt->stream) {
+      nread = stream_read(ls, fd);
+      buf = ls->stream.buf;
+    } else {
+      nread = guicall(SYS_getdents64, fd, buf, buf_size);
+    }
+    if (nread <= 0) {
+      return;
+    }
+    ++ls->reads;
+
+    if (opt->long_format) {
+      gui_arena_mark mark = gui_arena_save(&ls->scratch);
+      unsigned mask = table_begin(ls, opt);
+      table_gather(ls, fd, buf, (size_t)nread, opt);
+      table_emit(ls, fd, mask, out, subdirs, opt);
+      gui_arena_rewind(&ls->scratch, mark);
+    } else {
+      stream_names(ls, fd, buf, (size_t)nread, out, subdirs, opt);
+    }
+    if (opt->stream && out == gui_stdout) {
+      gui_out_flush(out);
     }
   }
+}
 
-  guicall(SYS_close, fd);
-  guicall(SYS_munmap, buf, buf_size);
+/*
+ * ===================================
+ * =Counting (--count and --summary)=
+ * ===================================
+ *
+ * Each directory's listing is replaced by one line of counts, and the walk
+ * runs as usual around it. --count needs nothing but getdents64: d_type
+ * says which entries are directories (statx only resolves DT_UNKNOWN).
+ * --summary also adds up sizes and blocks, which come from STATX_SIZE and
+ * STATX_BLOCKS requests batched through the entry table, one getdents64
+ * batch at a time.
+ */
+
+void counts_add(Counts *sum, const Counts *c) {
+  sum->files += c->files;
+  sum->dirs += c->dirs;
+  sum->bytes += c->bytes;
+  sum->blocks += c->blocks;
+  sum->counted += c->counted;
 }
 
-void list(const char *path, Options *opt) {
-  int fd = guicall(SYS_open, path, O_RDONLY | O_DIRECTORY);
-  if (fd < 0) {
-    const char *msg = "Open syscall failed.\n";
-    guicall(SYS_write, STDERR_FILENO, msg, guilen(msg));
-    guicall(SYS_exit, 1);
+/**
+ * @brief Prints one line of counts, as the grand total when 'total' is set.
+ * Machine formats print {"files":F,"dirs":D,...} objects (the total wrapped
+ * in {"total":...}) or "F\tD..." records (the total led by a "total" field).
+ */
+
+void write_counts(gui_out *out, const Counts *c, int total, Options *opt) {
+  if (opt->format != FORMAT_TEXT) {
+    if (total) {
+      gui_out_str(out, opt->format == FORMAT_JSON ? "{\"total\":" : "total\t");
+    }
+    if (opt->format == FORMAT_JSON) {
+      gui_out_str(out, "{\"files\":");
+    }
+    gui_out_unum(out, c->files);
+    record_num(out, ",\"dirs\":", c->dirs, opt);
+    if (opt->summary) {
+      record_num(out, ",\"bytes\":", c->bytes, opt);
+      record_num(out, ",\"blocks\":", c->blocks, opt);
+    }
+    if (opt->format == FORMAT_JSON) {
+      gui_out_str(out, total ? "}}" : "}");
+    }
+    gui_out_char(out, opt->eol);
+    return;
   }
 
-  size_t buf_size = (1024 * 32);
-  char *buf = (char *)guicall(SYS_mmap, NULL, buf_size, PROT_READ | PROT_WRITE,
-                              MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-  if (buf == MAP_FAILED) {
-    const char *msg = "MMap syscall failed.\n";
-    guicall(SYS_write, STDERR_FILENO, msg, guilen(msg));
-    guicall(SYS_close, fd);
-    guicall(SYS_exit, 1);
+  if (total) {
+    gui_out_char(out, opt->eol);
+    gui_out_str(out, "total: ");
+  }
+  gui_out_unum(out, c->files);
+  gui_out_str(out, c->files == 1 ? " file, " : " files, ");
+  gui_out_unum(out, c->dirs);
+  gui_out_str(out, c->dirs == 1 ? " directory" : " directories");
+  if (opt->summary) {
+    gui_out_str(out, ", ");
+    if (opt->human) {
+      char size[GUI_FMT_MAX];
+      gui_out_write(out, size, gui_fmt_human(size, c->bytes));
+    } else {
+      gui_out_unum(out, c->bytes);
+      gui_out_str(out, " bytes");
+    }
+    gui_out_str(out, ", ");
+    gui_out_unum(out, c->blocks);
+    gui_out_str(out, " blocks");
+  }
+  gui_out_char(out, opt->eol);
+}
+
+/**
+ * @brief Counts the shown entries of one getdents64 batch into 'c'.
+ */
+
+void count_batch(Lister *ls, int fd, char *buf, size_t nread, Counts *c,
+                 NameList *subdirs, Options *opt) {
+  for (size_t bpos = 0; bpos < nread;) {
+    struct linux_dirent64 *d = (void *)(buf + bpos);
+    bpos += d->d_reclen;
+    if (guicmp(d->d_name, ".") == 0 || guicmp(d->d_name, "..") == 0) {
+      continue;
+    }
+    ++ls->entries;
+    int dir = entry_type(fd, d) == DT_DIR;
+    if (opt->recursive && dir) {
+      names_add(subdirs, d->d_name);
+    }
+    if (opt->all || d->d_name[0] != '.') {
+      ++*(dir ? &c->dirs : &c->files);
+    }
+  }
+}
+
+/**
+ * @brief --summary: the same through the entry table, with the sizes.
+ */
+
+void summarize_batch(Lister *ls, int fd, char *buf, size_t nread, Counts *c,
+                     NameList *subdirs, Options *opt) {
+  gui_arena_mark mark = gui_arena_save(&ls->scratch);
+  EntryTable *table = &ls->table;
+  unsigned mask = table_begin(ls, opt);
+  table_gather(ls, fd, buf, nread, opt);
+  table_fetch_meta(table, ls->stat, fd, mask);
+
+  for (size_t i = 0; i < table->count; ++i) {
+    Entry *e = entry_of_name(table->items[i].ptr);
+    int dir = e->type == DT_DIR;
+    if (opt->recursive && dir) {
+      names_add(subdirs, e->name);
+    }
+    if (!e->shown) {
+      continue;
+    }
+    ++*(dir ? &c->dirs : &c->files);
+    if (e->res == 0) {
+      c->bytes += entry_meta(e)->stx_size;
+      c->blocks += entry_meta(e)->stx_blocks;
+    }
   }
+  gui_arena_rewind(&ls->scratch, mark);
+}
 
+void count_entries(int fd, char *buf, size_t buf_size, gui_out *out,
+                   NameList *subdirs, Lister *ls, Options *opt) {
+  Counts c = {0, 0, 0, 0, 1};
   int nread;
   while ((nread = guicall(SYS_getdents64, fd, buf, buf_size)) > 0) {
-    for (size_t bpos = 0; bpos < (size_t)nread;) {
-      struct linux_dirent64 *d = (void *)(buf + bpos);
-      int hidden = d->d_name[0] == '.';
+    ++ls->reads;
+    if (opt->summary) {
+      summarize_batch(ls, fd, buf, (size_t)nread, &c, subdirs, opt);
+    } else {
+      count_batch(ls, fd, buf, (size_t)nread, &c, subdirs, opt);
+    }
+  }
+  write_counts(out, &c, 0, opt);
+  counts_add(&ls->totals, &c);
+}
 
-      if (!opt->all && hidden) {
-        bpos += d->d_reclen;
-        continue;
+/**
+ * @brief Reads the directory open on 'fd' through 'buf', formats its entries
+ * into 'out' and, with -r, records its subdirectories in 'subdirs'.
+ */
+
+void list_entries(int fd, char *buf, size_t buf_size, gui_out *out,
+                  NameList *subdirs, Lister *ls, Options *opt) {
+  if (opt->count) {
+    count_entries(fd, buf, buf_size, out, subdirs, ls, opt);
+  } else if (opt->stream ||
+             (opt->sort == SORT_NONE && !opt->long_format && !opt->columns)) {
+    stream_entries(fd, buf, buf_size, out, subdirs, ls, opt);
+  } else {
+    sort_entries(fd, buf, buf_size, out, subdirs, ls, opt);
+  }
+}
+
+static Lister list_lister;
+
+/*
+ * ======================
+ * =Sequential traversal=
+ * ======================
+ *
+ * Depth-first walk with an explicit stack of Frames, one per directory on
+ * the chain from the operand to the directory being listed. A directory is
+ * read completely (its subdirectories go to the names arena) before the
+ * walk descends, so a frame only needs its fd to open the next child, and
+ * its getdents buffer is back in the pool by then. Memory is therefore
+ * proportional to the depth of the chain, whatever the size of the tree.
+ *
+ * At most opt->max_fd directories are kept open. Past that, the fd of the
+ * outermost open ancestor is closed; when the walk climbs back to it, it is
+ * reopened through ".." of its child and checked against the device and
+ * inode recorded at close time.
+ */
+
+typedef struct {
+  int fd; // -1 while closed to stay within --max-fd.
+  Name *next; // Next subdirectory to descend into.
+  size_t path_mark;
+  gui_arena_mark names_mark;
+  uint64_t dev; // Recorded when the fd is closed early.
+  uint64_t ino;
+} Frame;
+
+static struct {
+  Frame *frames;
+  size_t cap; // In bytes.
+  size_t depth;
+  int open_fds;
+} walk;
+
+void open_failed(void) {
+  const char *msg = "Open syscall failed.\n";
+  gui_out_str(gui_stderr, msg);
+  gui_exit(1);
+}
+
+/**
+ * @brief Closes the fd of the outermost ancestor that still has one, after
+ * recording its identity for the reopen.
+ */
+
+void walk_shed_fd(void) {
+  for (size_t i = 0; i + 1 < walk.depth; ++i) {
+    Frame *f = &walk.frames[i];
+    if (f->fd < 0) {
+      continue;
+    }
+    struct stat64 st;
+    if (guicall(SYS_fstat, f->fd, &st) < 0) {
+      return;
+    }
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+    guicall(SYS_close, f->fd);
+    f->fd = -1;
+    --walk.open_fds;
+    return;
+  }
+}
+
+/**
+ * @brief Gives the parent of the top frame its fd back via "..", before the
+ * top frame is popped.
+ */
+
+void walk_reopen_parent(void) {
+  Frame *child = &walk.frames[walk.depth - 1];
+  Frame *parent = &walk.frames[walk.depth - 2];
+  int fd = guicall(SYS_openat, child->fd, "..", O_RDONLY | O_DIRECTORY);
+  struct stat64 st;
+  if (fd < 0 || guicall(SYS_fstat, fd, &st) < 0 || st.st_dev != parent->dev ||
+      st.st_ino != parent->ino) {
+    // The tree was moved under us; ".." is not the directory we left.
+    open_failed();
+  }
+  parent->fd = fd;
+  ++walk.open_fds;
+}
+
+/**
+ * @brief Opens 'name' relative to 'parent_fd', lists it and pushes its frame.
+ */
+
+void walk_push(int parent_fd, const char *name, gui_path *path, Options *opt) {
+  if (walk.open_fds >= opt->max_fd) {
+    walk_shed_fd();
+  }
+  int fd = guicall(SYS_openat, parent_fd, name, O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    open_failed();
+  }
+  ++walk.open_fds;
+
+  reserve(&walk.frames, &walk.cap, (walk.depth + 1) * sizeof(Frame));
+  Frame *f = &walk.frames[walk.depth++];
+  f->fd = fd;
+  f->path_mark = path->len;
+  f->names_mark = gui_arena_save(&list_lister.names);
+
+  char *buf = gui_pool_get(&list_lister.bufs);
+  if (buf == NULL) {
+    out_of_memory();
+  }
+  NameList subdirs;
+  names_init(&subdirs, &list_lister.names);
+  list_entries(fd, buf, LIST_BUF_SIZE, gui_stdout, &subdirs, &list_lister, opt);
+  // Back to the pool before descending: every level reuses the same buffer.
+  gui_pool_put(&list_lister.bufs, buf);
+  f->next = subdirs.head;
+}
+
+/**
+ * @brief Lists the operand 'path' and, with -r, everything below it. 'path'
+ * grows and shrinks with the walk and is left unchanged on return.
+ */
+
+void list_tree(gui_path *path, Options *opt) {
+  size_t base_len = path->len;
+  walk.depth = 0;
+  walk.open_fds = 0;
+  walk_push(AT_FDCWD, path->buf, path, opt);
+
+  while (walk.depth > 0) {
+    Frame *top = &walk.frames[walk.depth - 1];
+    Name *child = top->next;
+
+    if (child == NULL) {
+      if (walk.depth > 1 && walk.frames[walk.depth - 2].fd < 0) {
+        walk_reopen_parent();
       }
+      guicall(SYS_close, top->fd);
+      --walk.open_fds;
+      gui_arena_rewind(&list_lister.names, top->names_mark);
+      gui_path_pop(path, top->path_mark);
+      --walk.depth;
+      continue;
+    }
+    top->next = child->next;
+
+    size_t mark = path->len;
+    if (gui_path_push(path, child->name, guilen(child->name)) < 0) {
+      out_of_memory();
+    }
+    write_header(gui_stdout, path->buf, path->len, 0, opt);
+    walk_push(top->fd, child->name, path, opt);
+    walk.frames[walk.depth - 1].path_mark = mark;
+  }
+
+  gui_path_pop(path, base_len);
+}
+
+/*
+ * ===============================
+ * =Parallel traversal (--threads)=
+ * ===============================
+ *
+ * Worker threads list directories into per-directory memory streams and
+ * push the subdirectories they find onto their own work-stealing deque; idle
+ * workers steal from the others. The main thread does no listing: it walks
+ * the tree in the same pre-order the sequential code uses, waits for each
+ * directory to be finished, and copies its output to stdout. The output is
+ * therefore byte-for-byte the single-threaded output.
+ *
+ * Nodes come from the workers' arenas and go back to a shared free list
+ * once printed, each with the first NODE_OUT_SIZE bytes of output buffer
+ * inside it, so only directories with more output than that map memory.
+ */
 
-      if (guicmp(d->d_name, ".") != 0 && guicmp(d->d_name, "..") != 0) {
-        if (opt->long_format) {
-          show_long(path, d->d_name);
-        } else {
-          guicall(SYS_write, STDOUT_FILENO, d->d_name, guilen(d->d_name));
-          if (d->d_type == 4) {
-            guicall(SYS_write, STDOUT_FILENO, "/", 1);
+typedef struct DirNode {
+  struct DirNode *parent;
+  struct DirNode *first_child;
+  struct DirNode *next_sibling;
+  struct DirNode *cursor; // Printer: next child to print.
+  size_t mark;            // Printer: path length before this node's name.
+  int fd;
+  int fd_refs; // This node's listing + children that still have to openat().
+  int done;
+  int failed;
+  gui_out out;
+  char name[256];
+  char out_buf[NODE_OUT_SIZE]; // Recycled with the node.
+} DirNode;
+
+typedef struct {
+  gui_thread thread;
+  gui_deque deque;
+  NameList names;
+  DirNode *free_nodes; // Private cache, refilled from the shared free list.
+  gui_arena nodes;     // Where new nodes come from; they are never unmapped.
+  char *buf;
+  Lister lister;
+  unsigned seed;
+} Worker;
+
+static struct {
+  Options *opt;
+  const char *root_name;
+  Worker *workers;
+  int nworkers;
+  int64_t pending; // Nodes pushed but not yet listed.
+  int epoch;       // Bumped whenever new work is published.
+  int sleepers;
+  int finished;
+  DirNode *awaited; // Node the printer is sleeping on.
+  gui_mutex free_lock;
+  DirNode *free_nodes;
+} par;
+
+DirNode *node_alloc(Worker *w) {
+  if (w->free_nodes == NULL) {
+    gui_mutex_lock(&par.free_lock);
+    w->free_nodes = par.free_nodes;
+    par.free_nodes = NULL;
+    gui_mutex_unlock(&par.free_lock);
+  }
+  DirNode *node = w->free_nodes;
+  if (node != NULL) {
+    w->free_nodes = node->next_sibling;
+    return node;
+  }
+  node = gui_arena_alloc(&w->nodes, sizeof(DirNode));
+  if (node == NULL) {
+    out_of_memory();
+  }
+  return node;
+}
+
+void node_free(DirNode *node) {
+  gui_mutex_lock(&par.free_lock);
+  node->next_sibling = par.free_nodes;
+  par.free_nodes = node;
+  gui_mutex_unlock(&par.free_lock);
+}
+
+void node_init(DirNode *node, DirNode *parent) {
+  node->parent = parent;
+  node->first_child = NULL;
+  node->next_sibling = NULL;
+  node->fd = -1;
+  node->fd_refs = 0;
+  node->done = 0;
+  node->failed = 0;
+  gui_out_mem_init_buf(&node->out, node->out_buf, sizeof(node->out_buf));
+}
+
+/**
+ * @brief Drops one reference to the directory fd of 'node'; the last one
+ * closes it. Children hold a reference until they have opened themselves.
+ */
+
+void node_release_fd(DirNode *node) {
+  if (__atomic_sub_fetch(&node->fd_refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    guicall(SYS_close, node->fd);
+  }
+}
+
+void publish_work(void) {
+  __atomic_add_fetch(&par.epoch, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&par.sleepers, __ATOMIC_SEQ_CST) > 0) {
+    gui_futex_wake(&par.epoch, par.nworkers);
+  }
+}
+
+/**
+ * @brief Lists one directory on a worker: open it relative to its parent,
+ * format its entries, queue its subdirectories and mark it done.
+ */
+
+void process_node(Worker *w, DirNode *node) {
+  DirNode *parent = node->parent;
+  int fd = guicall(SYS_openat, parent ? parent->fd : AT_FDCWD,
+                   parent ? node->name : par.root_name,
+                   O_RDONLY | O_DIRECTORY);
+  if (parent != NULL) {
+    node_release_fd(parent);
+  }
+
+  if (fd < 0) {
+    node->failed = 1;
+  } else {
+    gui_arena_mark mark = gui_arena_save(&w->lister.names);
+    names_init(&w->names, &w->lister.names);
+    list_entries(fd, w->buf, LIST_BUF_SIZE, &node->out, &w->names, &w->lister,
+                 par.opt);
+    if (node->out.err != 0) {
+      out_of_memory();
+    }
+
+    // Build the children in directory order, then push them in reverse so
+    // this worker takes the first one next, just like the printer wants.
+    DirNode **link = &node->first_child;
+    int64_t count = 0;
+    for (Name *name = w->names.head; name != NULL; name = name->next) {
+      DirNode *child = node_alloc(w);
+      node_init(child, node);
+      guimemcpy(child->name, name->name, guilen(name->name) + 1);
+      *link = child;
+      link = &child->next_sibling;
+      ++count;
+    }
+    gui_arena_rewind(&w->lister.names, mark);
+
+    node->fd = fd;
+    node->fd_refs = (int)count + 1;
+    if (count > 0) {
+      __atomic_add_fetch(&par.pending, count, __ATOMIC_SEQ_CST);
+      DirNode *stack[64];
+      DirNode *child = node->first_child;
+      // Reverse in blocks so a huge directory does not need a huge array.
+      while (child != NULL) {
+        int n = 0;
+        while (child != NULL && n < 64) {
+          stack[n++] = child;
+          child = child->next_sibling;
+        }
+        while (n > 0) {
+          if (gui_deque_push(&w->deque, stack[--n]) < 0) {
+            out_of_memory();
           }
-          guicall(SYS_write, STDOUT_FILENO, "\n", 1);
         }
       }
-      bpos += d->d_reclen;
+      publish_work();
+    }
+    node_release_fd(node);
+  }
+
+  __atomic_store_n(&node->done, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&par.awaited, __ATOMIC_SEQ_CST) == node) {
+    gui_futex_wake(&node->done, 1);
+  }
+
+  if (__atomic_sub_fetch(&par.pending, 1, __ATOMIC_SEQ_CST) == 0) {
+    __atomic_store_n(&par.finished, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&par.epoch, 1, __ATOMIC_SEQ_CST);
+    gui_futex_wake(&par.epoch, par.nworkers);
+  }
+}
+
+DirNode *steal_work(Worker *w) {
+  // xorshift picks the first victim so thieves do not all pile on worker 0.
+  w->seed ^= w->seed << 13;
+  w->seed ^= w->seed >> 17;
+  w->seed ^= w->seed << 5;
+  int start = (int)(w->seed % (unsigned)par.nworkers);
+  for (int i = 0; i < par.nworkers; ++i) {
+    Worker *victim = &par.workers[(start + i) % par.nworkers];
+    if (victim == w) {
+      continue;
+    }
+    DirNode *node = gui_deque_steal(&victim->deque);
+    if (node != NULL) {
+      return node;
+    }
+  }
+  return NULL;
+}
+
+int worker_main(void *arg) {
+  Worker *w = (Worker *)arg;
+  for (;;) {
+    DirNode *node = gui_deque_take(&w->deque);
+    if (node == NULL) {
+      node = steal_work(w);
+    }
+    if (node == NULL) {
+      int epoch = __atomic_load_n(&par.epoch, __ATOMIC_SEQ_CST);
+      node = steal_work(w);
+      if (node == NULL) {
+        if (__atomic_load_n(&par.finished, __ATOMIC_SEQ_CST)) {
+          return 0;
+        }
+        __atomic_add_fetch(&par.sleepers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&par.epoch, __ATOMIC_SEQ_CST) == epoch) {
+          gui_futex_wait(&par.epoch, epoch);
+        }
+        __atomic_sub_fetch(&par.sleepers, 1, __ATOMIC_SEQ_CST);
+        continue;
+      }
     }
+    process_node(w, node);
+  }
+}
+
+void wait_node(DirNode *node) {
+  if (__atomic_load_n(&node->done, __ATOMIC_ACQUIRE)) {
+    return;
   }
+  __atomic_store_n(&par.awaited, node, __ATOMIC_SEQ_CST);
+  while (!__atomic_load_n(&node->done, __ATOMIC_SEQ_CST)) {
+    gui_futex_wait(&node->done, 0);
+  }
+  __atomic_store_n(&par.awaited, NULL, __ATOMIC_RELAXED);
+}
 
-  guicall(SYS_close, fd);
+/**
+ * @brief Emits the finished tree in sequential pre-order: a node's entries,
+ * then each child with its "\n<path>:\n" header. Nodes are recycled as soon
+ * as their whole subtree has been printed.
+ */
 
-  if (opt->recursive) {
-    scan_recursive(path, opt);
+void print_tree(DirNode *root, gui_path *path, Options *opt) {
+  wait_node(root);
+  if (root->failed) {
+    open_failed();
   }
+  gui_out_write(gui_stdout, root->out.buf, root->out.len);
+  gui_out_mem_free(&root->out);
+  root->cursor = root->first_child;
 
-  guicall(SYS_munmap, buf, buf_size);
+  DirNode *cur = root;
+  while (cur != NULL) {
+    DirNode *child = cur->cursor;
+    if (child == NULL) {
+      DirNode *up = cur == root ? NULL : cur->parent;
+      if (up != NULL) {
+        gui_path_pop(path, cur->mark);
+      }
+      node_free(cur);
+      cur = up;
+      continue;
+    }
+    cur->cursor = child->next_sibling;
+
+    child->mark = path->len;
+    if (gui_path_push(path, child->name, guilen(child->name)) < 0) {
+      out_of_memory();
+    }
+    write_header(gui_stdout, path->buf, path->len, 0, opt);
+
+    wait_node(child);
+    if (child->failed) {
+      open_failed();
+    }
+    gui_out_write(gui_stdout, child->out.buf, child->out.len);
+    gui_out_mem_free(&child->out);
+    child->cursor = child->first_child;
+    cur = child;
+  }
+}
+
+/**
+ * @brief Raises the soft open-file limit to the hard one: in parallel mode
+ * every directory with unopened children keeps its fd open.
+ */
+
+void raise_fd_limit(void) {
+  uint64_t lim[2];
+  if (guicall(SYS_prlimit64, 0, RLIMIT_NOFILE, NULL, lim) == 0 &&
+      lim[0] < lim[1]) {
+    lim[0] = lim[1];
+    guicall(SYS_prlimit64, 0, RLIMIT_NOFILE, lim, NULL);
+  }
+}
+
+/**
+ * @brief -r over 'name' with opt->threads workers; same output as list().
+ */
+
+void list_parallel(const char *name, gui_path *path, Options *opt) {
+  static Worker workers[MAX_THREADS];
+  int n = opt->threads;
+
+  par.opt = opt;
+  par.root_name = name;
+  par.workers = workers;
+  par.nworkers = n;
+  par.pending = 1;
+  par.finished = 0;
+  par.awaited = NULL;
+
+  for (int i = 0; i < n; ++i) {
+    Worker *w = &workers[i];
+    lister_init(&w->lister, opt);
+    if (w->buf == NULL) {
+      gui_arena_init(&w->nodes, NODE_CHUNK_SIZE, 0);
+      w->buf = gui_pool_get(&w->lister.bufs);
+      if (w->buf == NULL) {
+        out_of_memory();
+      }
+    }
+    if (gui_deque_init(&w->deque) < 0) {
+      out_of_memory();
+    }
+    w->seed = 2463534242u + (unsigned)i * 7919u;
+  }
+
+  DirNode *root = node_alloc(&workers[0]);
+  node_init(root, NULL);
+  gui_deque_push(&workers[0].deque, root);
+
+  for (int i = 0; i < n; ++i) {
+    if (gui_thread_spawn(&workers[i].thread, worker_main, &workers[i]) < 0) {
+      out_of_memory();
+    }
+  }
+
+  print_tree(root, path, opt);
+
+  for (int i = 0; i < n; ++i) {
+    gui_thread_join(&workers[i].thread);
+    gui_deque_destroy(&workers[i].deque);
+  }
+}
+
+int default_max_fd(void) {
+  uint64_t lim[2];
+  if (guicall(SYS_prlimit64, 0, RLIMIT_NOFILE, NULL, lim) < 0 ||
+      lim[0] < 2 + FD_RESERVE) {
+    return 2;
+  }
+  return lim[0] - FD_RESERVE > 1 << 20 ? 1 << 20 : (int)(lim[0] - FD_RESERVE);
+}
+
+void list_operand(gui_path *path, Options *opt) {
+  if (opt->recursive && opt->threads > 1) {
+    raise_fd_limit();
+    list_parallel(path->buf, path, opt);
+  } else {
+    lister_init(&list_lister, opt);
+    list_tree(path, opt);
+  }
+}
+
+uint64_t now_ns(void) {
+  int64_t ts[2];
+  guicall(SYS_clock_gettime, CLOCK_MONOTONIC, ts);
+  return (uint64_t)ts[0] * 1000000000 + (uint64_t)ts[1];
+}
+
+/**
+ * @brief --count: the total line, when more than one directory was counted.
+ */
+
+void print_totals(Options *opt) {
+  Counts total = list_lister.totals;
+  for (int i = 0; par.workers != NULL && i < par.nworkers; ++i) {
+    counts_add(&total, &par.workers[i].lister.totals);
+  }
+  if (total.counted > 1) {
+    write_counts(gui_stdout, &total, 1, opt);
+  }
+}
+
+/**
+ * @brief --stats: totals of every lister that ran, the workers' included.
+ */
+
+void print_stats(Options *opt, uint64_t elapsed) {
+  uint64_t entries = list_lister.entries;
+  uint64_t reads = list_lister.reads;
+  size_t peak = list_lister.peak_read;
+  for (int i = 0; par.workers != NULL && i < par.nworkers; ++i) {
+    Lister *ls = &par.workers[i].lister;
+    entries += ls->entries;
+    reads += ls->reads;
+    peak = ls->peak_read > peak ? ls->peak_read : peak;
+  }
+  uint64_t us = elapsed / 1000 ? elapsed / 1000 : 1;
+
+  gui_out *err = gui_stderr;
+  gui_out_str(err, "mini-ls: ");
+  gui_out_unum(err, entries);
+  gui_out_str(err, " entries in ");
+  gui_out_unum(err, us / 1000);
+  gui_out_str(err, " ms (");
+  gui_out_unum(err, (uint64_t)((unsigned __int128)entries * 1000000 / us));
+  gui_out_str(err, " entries/s), ");
+  gui_out_unum(err, reads);
+  gui_out_str(err, " getdents64 batches");
+  if (opt->stream) {
+    gui_out_str(err, ", largest batch ");
+    gui_out_unum(err, (peak + 1023) / 1024);
+    gui_out_str(err, " KiB");
+  }
+  gui_out_char(err, '\n');
+}
+
+/**
+ * @brief Takes the -C line width from the terminal unless -w gave one, and
+ * makes -C the default when stdout is a terminal, like GNU ls.
+ */
+
+void terminal_layout(Options *opt, int format_set) {
+  struct winsize ws;
+  int tty = guicall(SYS_ioctl, 1, TIOCGWINSZ, &ws) == 0;
+  if (opt->width == 0) {
+    opt->width = tty && ws.ws_col > 0 ? ws.ws_col : DEFAULT_WIDTH;
+  }
+  if (tty && !format_set) {
+    opt->columns = 1;
+  }
+}
+
+/**
+ * @brief The FORMAT_* named by the argument of --format; anything else is
+ * a usage error.
+ */
+
+int parse_format(const char *name) {
+  if (guicmp(name, "text") == 0) {
+    return FORMAT_TEXT;
+  }
+  if (guicmp(name, "json") == 0) {
+    return FORMAT_JSON;
+  }
+  if (guicmp(name, "tsv") == 0) {
+    return FORMAT_TSV;
+  }
+  gui_out_str(gui_stderr, "mini-ls: invalid --format '");
+  gui_out_str(gui_stderr, name);
+  gui_out_str(gui_stderr, "' (expected text, json or tsv)\n");
+  gui_exit(2);
 }
 
 int main(int argc, char *argv[]) {
-  Options opt = {0, 0, 0};
+  Options opt = {0, 0, 0, 1, SORT_NAME, 0, 0, 0, 0, 0,
+                 0, 0, 0, 0, FORMAT_TEXT, '\n'};
 
-  static struct option long_opts[] = {{"recursive", no_argument, 0, 'r'},
-                                      {"all", no_argument, 0, 'a'},
-                                      {"long", no_argument, 0, 'l'},
-                                      {"help", no_argument, NULL, 'h'},
-                                      {0, 0, 0, 0}};
+  static const gui_option long_opts[] = {
+      {"recursive", GUI_NO_ARG, 'r'},
+      {"all", GUI_NO_ARG, 'a'},
+      {"long", GUI_NO_ARG, 'l'},
+      {"human-readable", GUI_NO_ARG, 'h'},
+      {"numeric-uid-gid", GUI_NO_ARG, 'n'},
+      {"width", GUI_REQUIRED_ARG, 'w'},
+      {"stream", GUI_NO_ARG, OPT_STREAM},
+      {"stats", GUI_NO_ARG, OPT_STATS},
+      {"count", GUI_NO_ARG, OPT_COUNT},
+      {"summary", GUI_NO_ARG, OPT_SUMMARY},
+      {"zero", GUI_NO_ARG, '0'},
+      {"format", GUI_REQUIRED_ARG, OPT_FORMAT},
+      {"help", GUI_NO_ARG, OPT_HELP},
+      {"threads", GUI_REQUIRED_ARG, OPT_THREADS},
+      {"max-fd", GUI_REQUIRED_ARG, OPT_MAX_FD},
+      {NULL, 0, 0}};
 
+  int format_set = 0; // -l, -n, -C or -1 was given.
+  gui_opt_state args = GUI_OPT_STATE_INIT;
   int c;
-  while ((c = getopt_long(argc, argv, "rahl", long_opts, NULL)) != -1) {
+  while ((c = gui_getopt_long(&args, argc, argv, "rahlnCw:1UtS0",
+                              long_opts)) != -1) {
     switch (c) {
     case 'r':
       opt.recursive = 1;
       break;
     case 'h':
+      opt.human = 1;
+      break;
+    case OPT_HELP:
       show_help();
       break;
+    case OPT_STREAM:
+      opt.stream = 1;
+      break;
+    case OPT_STATS:
+      opt.stats = 1;
+      break;
+    case OPT_SUMMARY:
+      opt.summary = 1;
+      opt.count = 1;
+      break;
+    case OPT_COUNT:
+      opt.count = 1;
+      break;
     case 'a':
       opt.all = 1;
       break;
     case 'l':
       opt.long_format = 1;
+      opt.columns = 0;
+      format_set = 1;
+      break;
+    case 'n':
+      opt.long_format = 1;
+      opt.numeric = 1;
+      format_set = 1;
+      break;
+    case 'C':
+      opt.columns = 1;
+      opt.long_format = 0;
+      format_set = 1;
+      break;
+    case '1':
+      opt.columns = 0;
+      opt.long_format = 0;
+      format_set = 1;
+      break;
+    case 'w':
+      opt.width = guitoi(args.arg);
+      if (opt.width < 1) {
+        opt.width = 1;
+      }
+      break;
+    case 'U':
+      opt.sort = SORT_NONE;
+      break;
+    case '0':
+      opt.eol = '\0';
+      break;
+    case OPT_FORMAT:
+      opt.format = parse_format(args.arg);
+      break;
+    case 't':
+      opt.sort = SORT_TIME;
+      break;
+    case 'S':
+      opt.sort = SORT_SIZE;
+      break;
+    case OPT_THREADS:
+      opt.threads = guitoi(args.arg);
+      if (opt.threads < 1) {
+        opt.threads = 1;
+      } else if (opt.threads > MAX_THREADS) {
+        opt.threads = MAX_THREADS;
+      }
+      break;
+    case OPT_MAX_FD:
+      opt.max_fd = guitoi(args.arg);
+      // The walk needs a parent and a child open at the same time.
+      if (opt.max_fd < 2) {
+        opt.max_fd = 2;
+      }
       break;
     }
   }
+  if (opt.max_fd == 0) {
+    opt.max_fd = default_max_fd();
+  }
+  terminal_layout(&opt, format_set);
+  if (opt.format != FORMAT_TEXT || opt.eol != '\n') {
+    // Machine-readable output is one entry per line.
+    opt.columns = 0;
+  }
+  if (opt.stream || opt.count) {
+    // Anything else would need the whole directory first; counts do not
+    // depend on the order either.
+    opt.sort = SORT_NONE;
+    opt.columns = 0;
+    opt.long_format = opt.count ? 0 : opt.long_format;
+  }
+  uint64_t start = now_ns();
+  gui_ids_init(&users, GUI_IDS_PASSWD);
+  gui_ids_init(&groups, GUI_IDS_GROUP);
 
-  if (optind == argc) {
-    list(".", &opt);
+  gui_path path;
+  if (args.ind == argc) {
+    if (gui_path_init(&path, ".") < 0) {
+      out_of_memory();
+    }
+    list_operand(&path, &opt);
+    gui_path_free(&path);
   } else {
-    for (int i = optind; i < argc; ++i) {
-      if (argc - optind > 1) {
-        guicall(SYS_write, STDOUT_FILENO, argv[i], guilen(argv[i]));
-        guicall(SYS_write, STDOUT_FILENO, ":", 1);
-        guicall(SYS_write, STDOUT_FILENO, "\n", 1);
+    for (int i = args.ind; i < argc; ++i) {
+      if (argc - args.ind > 1) {
+        write_header(gui_stdout, argv[i], guilen(argv[i]), i == args.ind,
+                     &opt);
       }
-      list(argv[i], &opt);
-      if (i < argc - 1 && argc - optind > 1) {
-        guicall(SYS_write, STDOUT_FILENO, "\n", 1);
+      if (gui_path_init(&path, argv[i]) < 0) {
+        out_of_memory();
       }
+      list_operand(&path, &opt);
+      gui_path_free(&path);
     }
   }
-  guicall(SYS_exit, 0);
+  if (opt.count) {
+    print_totals(&opt);
+  }
+  if (opt.stats) {
+    print_stats(&opt, now_ns() - start);
+  }
+  gui_exit(0);
 }
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include <linux/limits.h>
+#include "out.h"
 #include "sys/guicall.h"
 #include "sys/sysnums.h"
 
@@ -58,12 +59,12 @@ int main(int argc, char *argv[]) {
                 "Usage: mini-pwd [-L|-P]\n"
                 "  -L  Use PWD from environment (default)\n"
                 "  -P  Avoid symlinks (physical path)\n";
-            guicall(SYS_write, STDOUT_FILENO, help_msg, guilen(help_msg));
-            guicall(SYS_exit, 0);
+            gui_out_str(gui_stdout, help_msg);
+            gui_exit(0);
         } else if (arg[0] == '-') {
             const char *err = "mini-pwd: invalid option\n";
-            guicall(SYS_write, STDERR_FILENO, err, guilen(err));
-            guicall(SYS_exit, 1);
+            gui_out_str(gui_stderr, err);
+            gui_exit(1);
         }
     }
     
@@ -73,9 +74,9 @@ int main(int argc, char *argv[]) {
         const char *pwd_value = get_env_var("PWD");
         
         if (pwd_value != NULL && is_absolute_path(pwd_value)) {
-            guicall(SYS_write, STDOUT_FILENO, pwd_value, guilen(pwd_value));
-            guicall(SYS_write, STDOUT_FILENO, "\n", 1);
-            guicall(SYS_exit, 0);
+            gui_out_str(gui_stdout, pwd_value);
+            gui_out_char(gui_stdout, '\n');
+            gui_exit(0);
         }
     }
     
@@ -83,13 +84,13 @@ int main(int argc, char *argv[]) {
     
     if (ret < 0) {
         const char *prefix = "mini-pwd: ";
-        guicall(SYS_write, STDERR_FILENO, prefix, guilen(prefix));
-        gui_perror(NULL);
-        guicall(SYS_exit, 1);
+        gui_out_str(gui_stderr, prefix);
+        gui_perror(NULL, gui_errno(ret));
+        gui_exit(1);
     }
     
-    guicall(SYS_write, STDOUT_FILENO, cwd_buffer, guilen(cwd_buffer));
-    guicall(SYS_write, STDOUT_FILENO, "\n", 1);
+    gui_out_str(gui_stdout, cwd_buffer);
+    gui_out_char(gui_stdout, '\n');
     
-    guicall(SYS_exit, 0);
+    gui_exit(0);
 }